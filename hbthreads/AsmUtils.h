@@ -24,4 +24,17 @@ static inline uint64_t tic() {
     return __builtin_ia32_rdtsc();
 }
 
+// Hints the processor that we are inside a spin-wait loop
+//
+// On x86 this is the PAUSE instruction, which delays the next iteration by a
+// few dozen cycles, lowers the power drawn by the spinning core and leaves
+// execution resources to its hyperthread sibling.
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
 }  // namespace hbthreads
@@ -88,6 +88,20 @@ struct BufferPrinter {
         return out << reinterpret_cast<uint64_t>(ptr);
     }
 
+    //! Stream/prints an unsigned integer in decimal, for counters
+    BufferPrinter& dec(uint64_t value) {
+        char digits[20];
+        size_t nd = 0;
+        do {
+            digits[nd++] = '0' + (value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (nd > 0) {
+            *_ptr++ = digits[--nd];
+        }
+        return *this;
+    }
+
 private:
     //! Helper - returns the ascii digit given the value
     static int digit(int ch) {
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/eventfd.h>
+#include <utility>
+#include <unistd.h>
+
+namespace hbthreads {
+
+//! Size we pad to so producer and consumer fields do not share cache lines
+static constexpr std::size_t CacheLineSize = 64;
+
+//! Bounded single producer, single consumer ring
+//! Each side keeps a cached copy of the other side's index so it only touches
+//! the shared cache line when the cached value says the ring is full/empty
+template <typename T>
+class SpscRing {
+public:
+    //! Capacity must be a power of two
+    SpscRing(std::size_t capacity)
+        : _slots(new T[capacity]), _mask(capacity - 1), _tail(0), _head_cache(0),
+          _head(0), _tail_cache(0) {
+        assert((capacity > 0) && ((capacity & (capacity - 1)) == 0) &&
+               "Capacity must be a power of two");
+    }
+
+    //! Producer side. Returns false if the ring is full
+    template <typename U>
+    bool push(U&& value) {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head_cache > _mask) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail - _head_cache > _mask) return false;
+        }
+        _slots[tail & _mask] = std::forward<U>(value);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer side. Calls `func` with up to `max` items, returns how many
+    template <typename Func>
+    std::size_t consume(Func&& func, std::size_t max) {
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        if (_tail_cache == head) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+        }
+        std::size_t count = _tail_cache - head;
+        if (count > max) count = max;
+        for (std::size_t j = 0; j < count; ++j) {
+            func(_slots[(head + j) & _mask]);
+        }
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    //! Consumer side. True if there is nothing to consume
+    bool empty() const {
+        return _tail.load(std::memory_order_acquire) ==
+               _head.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<T[]> _slots;
+    std::size_t _mask;
+
+    // Producer cache line
+    alignas(CacheLineSize) std::atomic<std::size_t> _tail;
+    std::size_t _head_cache;
+
+    // Consumer cache line
+    alignas(CacheLineSize) std::atomic<std::size_t> _head;
+    std::size_t _tail_cache;
+    char _pad[CacheLineSize - sizeof(std::size_t) - sizeof(std::atomic<std::size_t>)];
+};
+
+//! Bounded multiple producer, single consumer ring
+//! Producers claim slots with a CAS on the tail and publish them through a
+//! per-slot sequence number, so a slow producer never exposes a half written slot.
+//! Items are consumed in order so a producer preempted between claiming and
+//! publishing its slot holds back the consumer: producers finding the ring full
+//! should back off with a sleep rather than spin.
+template <typename T>
+class MpscRing {
+public:
+    //! Capacity must be a power of two
+    MpscRing(std::size_t capacity)
+        : _slots(new Slot[capacity]), _mask(capacity - 1), _tail(0), _head(0) {
+        assert((capacity > 0) && ((capacity & (capacity - 1)) == 0) &&
+               "Capacity must be a power of two");
+        for (std::size_t j = 0; j < capacity; ++j) {
+            _slots[j].sequence.store(j, std::memory_order_relaxed);
+        }
+    }
+
+    //! Producer side, any thread. Returns false if the ring is full
+    template <typename U>
+    bool push(U&& value) {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &_slots[tail & _mask];
+            std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = std::intptr_t(sequence) - std::intptr_t(tail);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(tail, tail + 1,
+                                                std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                tail = _tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::forward<U>(value);
+        slot->sequence.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer side. Calls `func` with up to `max` items, returns how many
+    template <typename Func>
+    std::size_t consume(Func&& func, std::size_t max) {
+        std::size_t count = 0;
+        while (count < max) {
+            Slot& slot(_slots[_head & _mask]);
+            if (slot.sequence.load(std::memory_order_acquire) != _head + 1) break;
+            func(slot.value);
+            // Hand the slot over to producers of the next lap
+            slot.sequence.store(_head + _mask + 1, std::memory_order_release);
+            _head += 1;
+            count += 1;
+        }
+        return count;
+    }
+
+    //! Consumer side. True if there is nothing to consume
+    bool empty() const {
+        const Slot& slot(_slots[_head & _mask]);
+        return slot.sequence.load(std::memory_order_acquire) != _head + 1;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    std::size_t _mask;
+
+    // Shared by all producers
+    alignas(CacheLineSize) std::atomic<std::size_t> _tail;
+
+    // Consumer only
+    alignas(CacheLineSize) std::size_t _head;
+    char _pad[CacheLineSize - sizeof(std::size_t)];
+};
+
+//! A bounded channel from other OS threads or reactors to one light thread.
+//! The consumer can be woken up through an eventfd doorbell, which is monitored
+//! like any socket and only rung when the consumer parked itself, so a busy
+//! consumer costs producers no syscalls. A typical consumer loop is
+//!
+//!     reactor->monitor(channel.fd(), this, MonitorFlags::EdgeTriggered);
+//!     while (true) {
+//!         if (channel.consume(handler) == 0 && channel.park()) wait();
+//!     }
+//!
+//! Edge triggered monitoring is recommended: the counter is reset on a best
+//! effort basis only, and level triggered reactors may see an extra wakeup.
+template <typename T, typename Ring>
+class Channel {
+public:
+    //! Capacity must be a power of two. Without a doorbell `fd()` returns -1
+    Channel(std::size_t capacity, bool doorbell = true)
+        : _ring(capacity), _doorbell(-1), _parked(false), _armed(false) {
+        if (doorbell) {
+            _doorbell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+    }
+
+    //! Closes the doorbell
+    ~Channel() {
+        if (_doorbell >= 0) ::close(_doorbell);
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    //! The doorbell descriptor, to be monitored by the consumer
+    int fd() const noexcept {
+        return _doorbell;
+    }
+
+    //! Producer side. Returns false if the channel is full
+    template <typename U>
+    bool push(U&& value) {
+        if (!_ring.push(std::forward<U>(value))) return false;
+        ring();
+        return true;
+    }
+
+    //! Consumer side. Calls `func(T&)` with up to `max` items, returns how many
+    template <typename Func>
+    std::size_t consume(Func&& func, std::size_t max = SIZE_MAX) {
+        return _ring.consume(std::forward<Func>(func), max);
+    }
+
+    //! Consumer side. Pops one item, returns false if empty
+    bool pop(T& value) {
+        return consume([&value](T& item) { value = std::move(item); }, 1) == 1;
+    }
+
+    //! Consumer side. True if there is nothing to consume
+    bool empty() const {
+        return _ring.empty();
+    }
+
+    //! Consumer side. Asks producers to ring the doorbell on the next push.
+    //! Returns false if items arrived meanwhile, so the consumer should not wait
+    bool park() {
+        assert(_doorbell >= 0 && "Channel has no doorbell");
+        reconcile();
+        _parked.store(true, std::memory_order_relaxed);
+        _armed = true;
+        // Pairs with the fence in ring(): either we see the item or they see us
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_ring.empty()) return true;
+        reconcile();
+        return false;
+    }
+
+private:
+    //! Producer side. Rings the doorbell if the consumer is parked
+    void ring() {
+        if (_doorbell < 0) return;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_parked.load(std::memory_order_relaxed) &&
+            _parked.exchange(false, std::memory_order_acq_rel)) {
+            eventfd_write(_doorbell, 1);
+        }
+    }
+
+    //! Consumer side. Takes back the parked flag and resets the doorbell if
+    //! a producer rang it
+    void reconcile() {
+        if (!_armed) return;
+        _armed = false;
+        if (!_parked.exchange(false, std::memory_order_acq_rel)) {
+            eventfd_t value;
+            eventfd_read(_doorbell, &value);
+        }
+    }
+
+    Ring _ring;
+    int _doorbell;  //! eventfd, -1 if none
+    alignas(CacheLineSize) std::atomic<bool> _parked;  //! consumer waits on doorbell
+    bool _armed;  //! consumer set `_parked` and did not take it back yet
+};
+
+//! One producer thread to one light thread
+template <typename T>
+using SpscChannel = Channel<T, SpscRing<T>>;
+
+//! Any number of producer threads to one light thread
+template <typename T>
+using MpscChannel = Channel<T, MpscRing<T>>;
+
+}  // namespace hbthreads
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "Channel.h"
+#include "EpollReactor.h"
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace hbthreads;
+
+namespace {
+
+// Sums everything it receives until it got `expected` items
+class ConsumerThread : public LightThread {
+public:
+    ConsumerThread(MpscChannel<std::uint64_t>* channel, std::uint64_t expected)
+        : channel(channel), expected(expected) {
+    }
+    MpscChannel<std::uint64_t>* channel;
+    std::uint64_t expected;
+    std::uint64_t received = 0;
+    std::uint64_t sum = 0;
+    int wakeups = 0;
+
+    void run() override {
+        while (received < expected) {
+            std::size_t count = channel->consume([this](std::uint64_t value) {
+                received++;
+                sum += value;
+            });
+            if ((count == 0) && channel->park()) {
+                wait();
+                wakeups++;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+TEST(ChannelTest, SpscPushAndConsume) {
+    SpscChannel<int> channel(4, false);
+    EXPECT_EQ(channel.fd(), -1);
+    EXPECT_TRUE(channel.empty());
+    for (int j = 0; j < 4; ++j) {
+        EXPECT_TRUE(channel.push(j));
+    }
+    EXPECT_FALSE(channel.push(4));
+    EXPECT_FALSE(channel.empty());
+
+    // Batches are capped by `max`
+    std::vector<int> values;
+    EXPECT_EQ(channel.consume([&values](int value) { values.push_back(value); }, 3), 3UL);
+    EXPECT_EQ(values, (std::vector<int>{0, 1, 2}));
+
+    // Wraps around
+    EXPECT_TRUE(channel.push(4));
+    EXPECT_TRUE(channel.push(5));
+    int value;
+    for (int j = 3; j < 6; ++j) {
+        EXPECT_TRUE(channel.pop(value));
+        EXPECT_EQ(value, j);
+    }
+    EXPECT_FALSE(channel.pop(value));
+    EXPECT_TRUE(channel.empty());
+}
+
+TEST(ChannelTest, MpscPushAndConsume) {
+    MpscChannel<int> channel(4, false);
+    for (int lap = 0; lap < 3; ++lap) {
+        for (int j = 0; j < 4; ++j) {
+            EXPECT_TRUE(channel.push(j));
+        }
+        EXPECT_FALSE(channel.push(4));
+        int sum = 0;
+        EXPECT_EQ(channel.consume([&sum](int value) { sum += value; }), 4UL);
+        EXPECT_EQ(sum, 6);
+        EXPECT_TRUE(channel.empty());
+    }
+}
+
+TEST(ChannelTest, DoorbellOnlyWhenParked) {
+    SpscChannel<int> channel(16);
+    ASSERT_GE(channel.fd(), 0);
+    eventfd_t value;
+
+    // Consumer is not parked, producers do not ring
+    EXPECT_TRUE(channel.push(1));
+    EXPECT_NE(eventfd_read(channel.fd(), &value), 0);
+
+    // Items are there, parking is refused
+    EXPECT_FALSE(channel.park());
+    EXPECT_EQ(channel.consume([](int) {}), 1UL);
+
+    // Parked: the first push rings, the next ones do not
+    EXPECT_TRUE(channel.park());
+    EXPECT_TRUE(channel.push(2));
+    EXPECT_TRUE(channel.push(3));
+    ASSERT_EQ(eventfd_read(channel.fd(), &value), 0);
+    EXPECT_EQ(value, 1UL);
+}
+
+TEST(ChannelTest, MultipleProducersWakeReactorThread) {
+    const int NUM_PRODUCERS = 4;
+    const std::uint64_t NUM_ITEMS = 20000;
+
+    boost::container::pmr::monotonic_buffer_resource pool(64 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+    {
+        MpscChannel<std::uint64_t> channel(256);
+        EpollReactor reactor(storage, DateTime::msecs(10));
+        Pointer<ConsumerThread> consumer(
+            new ConsumerThread(&channel, NUM_PRODUCERS * NUM_ITEMS));
+        consumer->start(16 * 1024);
+        reactor.monitor(channel.fd(), consumer.get(), MonitorFlags::EdgeTriggered);
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < NUM_PRODUCERS; ++p) {
+            producers.emplace_back([&channel, NUM_ITEMS]() {
+                for (std::uint64_t j = 1; j <= NUM_ITEMS; ++j) {
+                    // Sleep rather than spin so a preempted producer gets to finish
+                    while (!channel.push(j)) usleep(10);
+                }
+            });
+        }
+        for (int j = 0; j < 100000 && reactor.active(); ++j) {
+            reactor.work();
+        }
+        for (std::thread& producer : producers) {
+            producer.join();
+        }
+
+        EXPECT_FALSE(reactor.active());
+        EXPECT_EQ(consumer->received, NUM_PRODUCERS * NUM_ITEMS);
+        EXPECT_EQ(consumer->sum, NUM_PRODUCERS * NUM_ITEMS * (NUM_ITEMS + 1) / 2);
+        EXPECT_GT(consumer->wakeups, 0);
+    }
+    storage = nullptr;
+}
@@ -0,0 +1,166 @@
+#include "CoSync.h"
+#include "Reactor.h"
+
+#include <cassert>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace hbthreads;
+
+void WaitQueue::push(LightThread* thread) {
+    assert(!thread->_wait_queued && "Thread is already parked");
+    thread->_wait_next = nullptr;
+    thread->_wait_queued = true;
+    if (_last != nullptr) {
+        _last->_wait_next = thread;
+    } else {
+        _first = thread;
+    }
+    _last = thread;
+    _size += 1;
+}
+
+LightThread* WaitQueue::pop() {
+    LightThread* thread = _first;
+    if (thread == nullptr) return nullptr;
+    _first = thread->_wait_next;
+    if (_first == nullptr) _last = nullptr;
+    thread->_wait_next = nullptr;
+    thread->_wait_queued = false;
+    _size -= 1;
+    return thread;
+}
+
+void WaitQueue::sleep(LightThread* thread) {
+    assert(thread == LightThread::current() && "Only the running thread can sleep");
+    // The reactor might resume us for a socket meanwhile, keep sleeping
+    while (thread->_wait_queued) {
+        thread->wait();
+    }
+}
+
+void WaitQueue::wake(LightThread* thread) {
+    Event event;
+    event.type = EventType::Wakeup;
+    event.fd = -1;
+    // The waker might be in the middle of the resume chain the woken thread is
+    // part of, e.g. a waiter unlocking a mutex before it sleeps. Resuming it
+    // from here would jump into a stack that is still running, so let a reactor
+    // do it from its own context once the chain returned. Threads that never
+    // went through a reactor go to the one running the waker
+    LightThread* waker = LightThread::current();
+    Reactor* reactor = thread->_scheduler;
+    if ((reactor == nullptr) && (waker != nullptr)) {
+        reactor = waker->_scheduler;
+    }
+    if (reactor != nullptr) {
+        reactor->post(thread, event);
+        return;
+    }
+    if (waker != nullptr) {
+        // Nobody could run it later and switching now is not safe
+        fprintf(stderr, "WaitQueue::wake(): no reactor to run the woken thread\n");
+        abort();
+    }
+    // Nothing else is running so it is safe to switch right away.
+    // Keeps the thread alive until it is done
+    Pointer<LightThread> guard(thread);
+    thread->resume(&event);
+}
+
+bool WaitQueue::wakeOne() {
+    LightThread* thread = pop();
+    if (thread == nullptr) return false;
+    wake(thread);
+    return true;
+}
+
+void WaitQueue::wakeAll() {
+    // Detach the current waiters so the ones parking again go to a fresh queue
+    LightThread* thread = _first;
+    _first = _last = nullptr;
+    _size = 0;
+    while (thread != nullptr) {
+        LightThread* next = thread->_wait_next;
+        thread->_wait_next = nullptr;
+        thread->_wait_queued = false;
+        wake(thread);
+        thread = next;
+    }
+}
+
+void CoMutex::lock() {
+    LightThread* self = LightThread::current();
+    assert(self != nullptr && "CoMutex can only be locked from a light thread");
+    if (_owner == nullptr) {
+        _owner = self;
+        return;
+    }
+    assert(_owner != self && "CoMutex is not recursive");
+    // unlock() makes us the owner before waking us
+    _waiters.park(self);
+}
+
+bool CoMutex::tryLock() {
+    assert(LightThread::current() != nullptr &&
+           "CoMutex can only be locked from a light thread");
+    if (_owner != nullptr) return false;
+    _owner = LightThread::current();
+    return true;
+}
+
+void CoMutex::unlock() {
+    assert(_owner == LightThread::current() && "CoMutex unlocked by another thread");
+    _owner = _waiters.pop();
+    if (_owner != nullptr) WaitQueue::wake(_owner);
+}
+
+void CoSemaphore::acquire() {
+    if (tryAcquire()) return;
+    LightThread* self = LightThread::current();
+    assert(self != nullptr && "CoSemaphore can only be acquired from a light thread");
+    // release() hands its unit over to us before waking us
+    _waiters.park(self);
+}
+
+bool CoSemaphore::tryAcquire() {
+    // Waiters come first
+    if ((_count == 0) || !_waiters.empty()) return false;
+    _count -= 1;
+    return true;
+}
+
+void CoSemaphore::release() {
+    if (!_waiters.wakeOne()) _count += 1;
+}
+
+void CoCondition::wait(CoMutex& mutex) {
+    LightThread* self = LightThread::current();
+    assert(self != nullptr && "CoCondition can only be waited from a light thread");
+    // Queue first: threads running before we sleep can notify us
+    _waiters.push(self);
+    mutex.unlock();
+    WaitQueue::sleep(self);
+    mutex.lock();
+}
+
+void CoCondition::notifyOne() {
+    _waiters.wakeOne();
+}
+
+void CoCondition::notifyAll() {
+    _waiters.wakeAll();
+}
+
+bool CoBarrier::arrive() {
+    _arrived += 1;
+    if (_arrived < _count) {
+        LightThread* self = LightThread::current();
+        assert(self != nullptr && "CoBarrier can only be waited from a light thread");
+        _waiters.park(self);
+        return false;
+    }
+    _arrived = 0;
+    _waiters.wakeAll();
+    return true;
+}
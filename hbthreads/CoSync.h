@@ -0,0 +1,150 @@
+#pragma once
+
+#include "LightThread.h"
+#include <cstdint>
+
+namespace hbthreads {
+
+//! Intrusive FIFO of light threads parked on a synchronization primitive.
+//! Threads are chained through a hook inside LightThread so parking never
+//! allocates, and a thread can be parked on one queue at a time.
+//! Waking a thread posts it on the run queue of the reactor that last posted or
+//! subscribed it, or else of the reactor running the waker, without going
+//! through the kernel, and it runs on the next `work()`. The waker never
+//! switches to it directly: it might be further up the very resume chain the
+//! waker runs in. Parked threads must be kept alive by their owner, and that
+//! reactor must outlive them.
+class WaitQueue {
+public:
+    //! Returns true if nobody is parked
+    bool empty() const noexcept {
+        return _first == nullptr;
+    }
+
+    //! Number of parked threads
+    std::uint32_t size() const noexcept {
+        return _size;
+    }
+
+    //! Appends the thread to the queue without suspending it
+    void push(LightThread* thread);
+
+    //! Removes the first thread from the queue without resuming it.
+    //! Returns null if the queue is empty
+    LightThread* pop();
+
+    //! Suspends the thread until it is popped from the queue.
+    //! Events the reactor delivers meanwhile are dropped
+    static void sleep(LightThread* thread);
+
+    //! Parks the thread: push() followed by sleep()
+    void park(LightThread* thread) {
+        push(thread);
+        sleep(thread);
+    }
+
+    //! Posts a popped thread to its reactor with a Wakeup event. Without any
+    //! reactor it is resumed right away from outside of light threads, and the
+    //! program aborts if woken from one
+    static void wake(LightThread* thread);
+
+    //! Pops and wakes the first thread. Returns false if the queue was empty
+    bool wakeOne();
+
+    //! Wakes all the threads parked so far, in order. Threads parking again
+    //! while being woken wait for the next call
+    void wakeAll();
+
+private:
+    LightThread* _first = nullptr;
+    LightThread* _last = nullptr;
+    std::uint32_t _size = 0;
+};
+
+//! A mutex for light threads sharing one OS thread.
+//! Ownership is handed over to the first waiter on unlock, so the lock is fair
+//! and waiters cannot be overtaken. Works with std::lock_guard.
+class CoMutex {
+public:
+    //! Takes the lock, parking the current thread while someone else owns it
+    void lock();
+
+    //! Takes the lock if it is free. Returns false otherwise
+    bool tryLock();
+
+    //! Releases the lock, handing it over to the next owner if any
+    void unlock();
+
+    //! Returns the thread owning the lock, null if free
+    LightThread* owner() const noexcept {
+        return _owner;
+    }
+
+private:
+    LightThread* _owner = nullptr;
+    WaitQueue _waiters;
+};
+
+//! A counting semaphore for light threads sharing one OS thread.
+//! Released units go straight to the first waiter.
+class CoSemaphore {
+public:
+    //! Starts with `count` available units
+    explicit CoSemaphore(std::uint32_t count = 0) : _count(count) {
+    }
+
+    //! Takes one unit, parking the current thread until one is available
+    void acquire();
+
+    //! Takes one unit if available. Returns false otherwise
+    bool tryAcquire();
+
+    //! Returns one unit, handing it over to the first waiter if any
+    void release();
+
+    //! Units available right now
+    std::uint32_t count() const noexcept {
+        return _count;
+    }
+
+private:
+    std::uint32_t _count;
+    WaitQueue _waiters;
+};
+
+//! A condition variable for light threads, used together with a CoMutex.
+//! There are no spurious wakeups from the primitive itself but, as usual, the
+//! predicate should be checked again after waiting.
+class CoCondition {
+public:
+    //! Releases the mutex, parks until notified and takes the mutex back
+    void wait(CoMutex& mutex);
+
+    //! Wakes up the first waiter
+    void notifyOne();
+
+    //! Wakes up all waiters
+    void notifyAll();
+
+private:
+    WaitQueue _waiters;
+};
+
+//! A reusable barrier for a fixed number of light threads
+class CoBarrier {
+public:
+    //! Number of threads to wait for at each phase
+    explicit CoBarrier(std::uint32_t count) : _count(count), _arrived(0) {
+    }
+
+    //! Parks until `count` threads arrived. The last one to arrive does not
+    //! park, it wakes the others and returns true
+    bool arrive();
+
+private:
+    std::uint32_t _count;
+    std::uint32_t _arrived;
+    WaitQueue _waiters;
+};
+
+}  // namespace hbthreads
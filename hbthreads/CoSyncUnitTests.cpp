@@ -0,0 +1,377 @@
+#include <gtest/gtest.h>
+#include "CoSync.h"
+#include "EpollReactor.h"
+#include <functional>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace hbthreads;
+
+namespace {
+
+// Runs whatever it is given
+class ScriptThread : public LightThread {
+public:
+    ScriptThread(std::function<void()> script) : script(std::move(script)) {
+    }
+    std::function<void()> script;
+
+    void run() override {
+        script();
+    }
+};
+
+// Resumes the thread as the reactor would
+bool poke(LightThread* thread) {
+    Event event;
+    event.type = EventType::SocketRead;
+    event.fd = -1;
+    return thread->resume(&event);
+}
+
+}  // namespace
+
+class CoSyncTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+        reactor = new EpollReactor(storage, DateTime::msecs(1));
+    }
+
+    void TearDown() override {
+        delete reactor;
+        for (int fd : fds) {
+            close(fd);
+        }
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    // Creates and starts a thread running `script`. Threads are subscribed to
+    // an idle socket so wakeups go through the reactor
+    Pointer<LightThread> spawn(std::function<void()> script) {
+        Pointer<LightThread> thread(new ScriptThread(std::move(script)));
+        int fd = eventfd(0, EFD_NONBLOCK);
+        EXPECT_GE(fd, 0);
+        fds.push_back(fd);
+        reactor->monitor(fd, thread.get());
+        thread->start(32 * 1024);
+        return thread;
+    }
+
+    // Creates a thread without sockets and runs `script` from the run queue
+    Pointer<LightThread> spawnPosted(std::function<void()> script) {
+        Pointer<LightThread> thread(new ScriptThread([script]() {
+            LightThread::current()->wait();
+            script();
+        }));
+        thread->start(32 * 1024);
+        Event event;
+        event.type = EventType::Wakeup;
+        event.fd = -1;
+        reactor->post(thread.get(), event);
+        runWoken();
+        return thread;
+    }
+
+    // Runs the threads woken so far
+    void runWoken() {
+        reactor->work();
+    }
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+    EpollReactor* reactor;
+    std::vector<int> fds;
+};
+
+TEST_F(CoSyncTest, CurrentThread) {
+    EXPECT_EQ(LightThread::current(), nullptr);
+    LightThread* seen = nullptr;
+    Pointer<LightThread> thread = spawn([&seen]() { seen = LightThread::current(); });
+    EXPECT_EQ(seen, thread.get());
+    EXPECT_EQ(LightThread::current(), nullptr);
+}
+
+TEST_F(CoSyncTest, WaitQueueOrder) {
+    WaitQueue queue;
+    std::string log;
+    Pointer<LightThread> threads[3];
+    for (int j = 0; j < 3; ++j) {
+        threads[j] = spawn([&queue, &log, j]() {
+            queue.park(LightThread::current());
+            log += char('a' + j);
+        });
+    }
+    EXPECT_EQ(queue.size(), 3U);
+
+    // Reactor events do not release a parked thread
+    EXPECT_TRUE(poke(threads[0].get()));
+    EXPECT_EQ(log, "");
+
+    // Woken threads run from the reactor
+    EXPECT_TRUE(queue.wakeOne());
+    EXPECT_EQ(log, "");
+    runWoken();
+    EXPECT_EQ(log, "a");
+    queue.wakeAll();
+    runWoken();
+    EXPECT_EQ(log, "abc");
+    EXPECT_TRUE(queue.empty());
+    EXPECT_FALSE(queue.wakeOne());
+}
+
+TEST_F(CoSyncTest, MutexHandsOverInOrder) {
+    CoMutex mutex;
+    std::string log;
+    Pointer<LightThread> threads[3];
+    for (int j = 0; j < 3; ++j) {
+        threads[j] = spawn([&mutex, &log, j]() {
+            mutex.lock();
+            log += char('A' + j);
+            // Hold the lock across a reactor wait
+            LightThread::current()->wait();
+            log += char('a' + j);
+            mutex.unlock();
+        });
+    }
+    EXPECT_EQ(log, "A");
+    EXPECT_EQ(mutex.owner(), threads[0].get());
+
+    // A parked thread stays parked if the reactor wakes it up
+    EXPECT_TRUE(poke(threads[2].get()));
+    EXPECT_EQ(log, "A");
+
+    // Unlocking hands the lock over, the next owner runs from the reactor
+    EXPECT_FALSE(poke(threads[0].get()));
+    EXPECT_EQ(log, "Aa");
+    EXPECT_EQ(mutex.owner(), threads[1].get());
+    runWoken();
+    EXPECT_EQ(log, "AaB");
+    EXPECT_FALSE(poke(threads[1].get()));
+    runWoken();
+    EXPECT_EQ(log, "AaBbC");
+    EXPECT_FALSE(poke(threads[2].get()));
+    EXPECT_EQ(log, "AaBbCc");
+    EXPECT_EQ(mutex.owner(), nullptr);
+}
+
+TEST_F(CoSyncTest, MutexTryLock) {
+    CoMutex mutex;
+    bool first = false;
+    bool second = true;
+    Pointer<LightThread> holder = spawn([&]() {
+        first = mutex.tryLock();
+        LightThread::current()->wait();
+        mutex.unlock();
+    });
+    Pointer<LightThread> other = spawn([&]() { second = mutex.tryLock(); });
+    EXPECT_TRUE(first);
+    EXPECT_FALSE(second);
+    EXPECT_FALSE(poke(holder.get()));
+    EXPECT_EQ(mutex.owner(), nullptr);
+}
+
+TEST_F(CoSyncTest, SemaphoreCounts) {
+    CoSemaphore semaphore(2);
+    int acquired = 0;
+    Pointer<LightThread> threads[4];
+    for (Pointer<LightThread>& thread : threads) {
+        thread = spawn([&]() {
+            semaphore.acquire();
+            acquired++;
+        });
+    }
+    EXPECT_EQ(acquired, 2);
+    EXPECT_EQ(semaphore.count(), 0U);
+
+    // Units go to waiters first
+    semaphore.release();
+    EXPECT_EQ(semaphore.count(), 0U);
+    runWoken();
+    EXPECT_EQ(acquired, 3);
+    semaphore.release();
+    runWoken();
+    EXPECT_EQ(acquired, 4);
+    EXPECT_EQ(semaphore.count(), 0U);
+    semaphore.release();
+    EXPECT_EQ(semaphore.count(), 1U);
+}
+
+TEST_F(CoSyncTest, ConditionProducerConsumer) {
+    CoMutex mutex;
+    CoCondition condition;
+    int items = 0;
+    int consumed = 0;
+    Pointer<LightThread> consumers[2];
+    for (Pointer<LightThread>& consumer : consumers) {
+        consumer = spawn([&]() {
+            while (consumed < 4) {
+                mutex.lock();
+                while (items == 0) condition.wait(mutex);
+                items--;
+                consumed++;
+                mutex.unlock();
+            }
+        });
+    }
+    Pointer<LightThread> producer = spawn([&]() {
+        for (int j = 0; j < 2; ++j) {
+            mutex.lock();
+            items++;
+            condition.notifyOne();
+            mutex.unlock();
+        }
+        mutex.lock();
+        items += 2;
+        condition.notifyAll();
+        mutex.unlock();
+    });
+    for (int j = 0; (j < 100) && (consumed < 4); ++j) {
+        runWoken();
+    }
+    EXPECT_EQ(consumed, 4);
+    EXPECT_EQ(items, 0);
+    EXPECT_EQ(mutex.owner(), nullptr);
+}
+
+TEST_F(CoSyncTest, BarrierPhases) {
+    CoBarrier barrier(3);
+    std::string log;
+    int leaders = 0;
+    Pointer<LightThread> threads[3];
+    for (int j = 0; j < 3; ++j) {
+        threads[j] = spawn([&, j]() {
+            for (int phase = 0; phase < 2; ++phase) {
+                log += char('0' + phase);
+                if (barrier.arrive()) leaders++;
+            }
+        });
+    }
+    // Nobody gets into a phase before everyone finished the previous one
+    runWoken();
+    runWoken();
+    EXPECT_EQ(log, "000111");
+    EXPECT_EQ(leaders, 2);
+}
+
+TEST_F(CoSyncTest, WokenThreadLeavesReactor) {
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    CoMutex mutex;
+    Pointer<LightThread> holder = spawn([&]() {
+        mutex.lock();
+        LightThread::current()->wait();
+        mutex.unlock();
+    });
+    Pointer<LightThread> waiter = spawn([&]() {
+        mutex.lock();
+        mutex.unlock();
+    });
+    reactor->monitor(fd, holder.get());
+    reactor->monitor(fd, waiter.get());
+    waiter.reset();
+
+    // The holder unlocks from the dispatch, the waiter finishes from the run queue
+    eventfd_write(fd, 1);
+    reactor->work();
+    runWoken();
+    EXPECT_FALSE(reactor->active());
+    close(fd);
+}
+
+TEST_F(CoSyncTest, ConditionWaitWithMutexWaiter) {
+    CoMutex mutex;
+    CoCondition condition;
+    bool ready = false;
+    std::string log;
+    Pointer<LightThread> consumer = spawn([&]() {
+        mutex.lock();
+        LightThread::current()->wait();
+        // The producer is parked on the mutex when we release it here
+        while (!ready) condition.wait(mutex);
+        log += 'c';
+        mutex.unlock();
+    });
+    Pointer<LightThread> producer = spawn([&]() {
+        mutex.lock();
+        ready = true;
+        condition.notifyOne();
+        log += 'p';
+        mutex.unlock();
+    });
+    EXPECT_EQ(mutex.owner(), consumer.get());
+
+    EXPECT_TRUE(poke(consumer.get()));
+    EXPECT_EQ(mutex.owner(), producer.get());
+    EXPECT_EQ(log, "");
+    for (int j = 0; (j < 10) && (log.size() < 2); ++j) {
+        runWoken();
+    }
+    EXPECT_EQ(log, "pc");
+    EXPECT_TRUE(consumer->finished());
+    EXPECT_TRUE(producer->finished());
+    EXPECT_EQ(mutex.owner(), nullptr);
+}
+
+TEST_F(CoSyncTest, ConditionWaitWithPostedThreads) {
+    // Same as above with threads that only ever ran from the run queue
+    CoMutex mutex;
+    CoCondition condition;
+    bool ready = false;
+    std::string log;
+    Pointer<LightThread> consumer = spawnPosted([&]() {
+        mutex.lock();
+        LightThread::current()->wait();
+        while (!ready) condition.wait(mutex);
+        log += 'c';
+        mutex.unlock();
+    });
+    Pointer<LightThread> producer = spawnPosted([&]() {
+        mutex.lock();
+        ready = true;
+        condition.notifyOne();
+        log += 'p';
+        mutex.unlock();
+    });
+    EXPECT_EQ(mutex.owner(), consumer.get());
+
+    EXPECT_TRUE(poke(consumer.get()));
+    EXPECT_EQ(mutex.owner(), producer.get());
+    EXPECT_EQ(log, "");
+    for (int j = 0; (j < 10) && (log.size() < 2); ++j) {
+        runWoken();
+    }
+    EXPECT_EQ(log, "pc");
+    EXPECT_TRUE(consumer->finished());
+    EXPECT_TRUE(producer->finished());
+}
+
+TEST_F(CoSyncTest, WaiterStartedOutsideReactor) {
+    CoMutex mutex;
+    std::string log;
+    Pointer<LightThread> holder = spawn([&]() {
+        mutex.lock();
+        LightThread::current()->wait();
+        log += 'h';
+        mutex.unlock();
+    });
+    // Never posted nor subscribed, it goes to the reactor running the holder
+    Pointer<LightThread> waiter(new ScriptThread([&]() {
+        mutex.lock();
+        log += 'w';
+        mutex.unlock();
+    }));
+    waiter->start(32 * 1024);
+
+    // The holder unlocks from the dispatch, the waiter runs from the run queue
+    eventfd_write(fds[0], 1);
+    reactor->work();
+    EXPECT_EQ(log, "hw");
+    EXPECT_TRUE(waiter->finished());
+}
@@ -1,12 +1,43 @@
 #include "EpollReactor.h"
 #include "SocketUtils.h"
+#include "AsmUtils.h"
 #include <array>
 // One the hidden great things about epoll is that you do not need to include
 // its header in the class header file like with poll()
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+// Kernel busy polling on epoll descriptors came with Linux 6.9 and glibc 2.40
+// Older headers do not have it so we define it here as in <linux/eventpoll.h>
+#ifndef EPOLL_IOC_BUSY_POLL
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPOLL_IOC_BUSY_POLL _IOW(0x8A, 0x1, struct epoll_params)
+#endif
 
 using namespace hbthreads;
 
+// Translates subscription flags into epoll flags
+// The kernel accepts EPOLLEXCLUSIVE only with a few other flags, which
+// excludes EPOLLONESHOT, EPOLLRDHUP and EPOLLPRI. The exclusive wakeup wins
+// as it is the one that cannot be emulated.
+static std::uint32_t eventMask(MonitorFlags flags) {
+    std::uint32_t mask = EPOLLIN | EPOLLERR;
+    if (hasFlags(flags, MonitorFlags::EdgeTriggered)) mask |= EPOLLET;
+    if (hasFlags(flags, MonitorFlags::Writable)) mask |= EPOLLOUT;
+    if (hasFlags(flags, MonitorFlags::Exclusive)) {
+        mask |= EPOLLEXCLUSIVE;
+    } else {
+        mask |= EPOLLRDHUP | EPOLLPRI;
+        if (hasFlags(flags, MonitorFlags::OneShot)) mask |= EPOLLONESHOT;
+    }
+    return mask;
+}
+
 // Passes the memory storage down to the Reactor base
 EpollReactor::EpollReactor(MemoryStorage* mem, DateTime timeout, int max_events)
     : Reactor(mem) {
@@ -32,7 +63,17 @@ bool EpollReactor::work() {
     // Allocate event buffer on stack (VLA for efficiency)
     // For production HFT, typical values: 256-1024
     epoll_event* events = (epoll_event*)alloca(_max_events * sizeof(epoll_event));
-    int nd = ::epoll_wait(_epollfd, events, _max_events, _timeout.msecs());
+
+    // Just peek at the sockets if threads are waiting to run
+    int timeout_ms = pollTimeout(_timeout).msecs();
+    int nd;
+    if (runnable()) {
+        nd = waitEvents(events, 0);
+    } else if ((_spin.spin.nsecs() > 0) || (_spin.pause.nsecs() > 0)) {
+        nd = spinWait(events, timeout_ms);
+    } else {
+        nd = waitEvents(events, timeout_ms);
+    }
     if (nd < 0) {
         // This should never happen but it is possible
         perror("EpollReactor::work() on epoll_wait");
@@ -44,17 +85,87 @@ bool EpollReactor::work() {
         const epoll_event& ev = events[j];
         // Notify reads
         if ((ev.events & EPOLLIN) != 0) {
-            notifyEvent(ev.data.fd, EventType::SocketRead);
+            deliverEvent(ev.data.fd, EventType::SocketRead);
+        }
+        // Notify room to write
+        if ((ev.events & EPOLLOUT) != 0) {
+            deliverEvent(ev.data.fd, EventType::SocketWriteable);
         }
         // Notify errors
         if ((ev.events & (EPOLLERR)) != 0) {
-            notifyEvent(ev.data.fd, EventType::SocketError);
+            deliverEvent(ev.data.fd, errorEvent(ev.data.fd));
         }
         // Notify hangup
         if ((ev.events & (EPOLLHUP)) != 0) {
-            notifyEvent(ev.data.fd, EventType::SocketHangup);
+            deliverEvent(ev.data.fd, EventType::SocketHangup);
         }
     }
+    flushEvents();
+
+    // Posted threads and expired timers
+    runQueued();
+    return true;
+}
+
+int EpollReactor::spinWait(epoll_event* events, int timeout_ms) {
+    // The window restarts on every productive poll
+    const DateTime spin_end = _last_event + _spin.spin;
+    const DateTime pause_end = spin_end + _spin.pause;
+    int nd;
+    while (true) {
+        nd = waitEvents(events, 0);
+        DateTime now = DateTime::now(DateTime::ClockType::Monotonic);
+        if (nd > 0) {
+            _last_event = now;
+            return nd;
+        }
+        if ((nd < 0) || (now >= pause_end)) break;
+        if (now >= spin_end) {
+            // Back off a bit so we do not hammer the kernel
+            for (std::uint32_t j = 0; j < _spin.pause_count; ++j) {
+                cpuRelax();
+            }
+        }
+    }
+    if (nd < 0) return nd;
+
+    // Nothing came in the whole window, sleep
+    _counters.blocked++;
+    nd = waitEvents(events, timeout_ms);
+    if (nd > 0) {
+        _last_event = DateTime::now(DateTime::ClockType::Monotonic);
+    }
+    return nd;
+}
+
+int EpollReactor::waitEvents(epoll_event* events, int timeout_ms) {
+    int nd = ::epoll_wait(_epollfd, events, _max_events, timeout_ms);
+    if (nd > 0) {
+        _counters.productive++;
+    } else if (nd == 0) {
+        _counters.empty++;
+    } else if (errno == EINTR) {
+        // A signal is not an error, just an empty poll
+        _counters.empty++;
+        nd = 0;
+    }
+    return nd;
+}
+
+bool EpollReactor::setSpinPolicy(const SpinPolicy& policy) {
+    _spin = policy;
+    if (_epollfd < 0) return false;
+
+    // Only touch the kernel setting if asked to, it may need privileges
+    if (policy.busy_poll.nsecs() <= 0) return true;
+    epoll_params params{};
+    params.busy_poll_usecs = policy.busy_poll.usecs();
+    params.busy_poll_budget = 8;  // the kernel default
+    params.prefer_busy_poll = 1;
+    if (::ioctl(_epollfd, EPOLL_IOC_BUSY_POLL, &params) != 0) {
+        perror("EpollReactor::setSpinPolicy() on ioctl(EPOLL_IOC_BUSY_POLL)");
+        return false;
+    }
     return true;
 }
 
@@ -70,12 +181,30 @@ void EpollReactor::onSocketOps(int fd, Operation ops) {
         case Operation::Added:
             // Tells the kernel about this new socket so we get notified
             event.data.fd = fd;
-            event.events = EPOLLIN | EPOLLRDHUP | EPOLLPRI | EPOLLERR;
+            event.events = eventMask(socketFlags(fd));
             res = epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &event);
             if (res != 0) {
                 perror("EpollReactor::onSocketOps() on epoll_ctl(ADD)");
             }
             break;
+        case Operation::Modified:
+            // Subscriptions changed the way the socket is watched
+            // EPOLLEXCLUSIVE can only be set on EPOLL_CTL_ADD and an exclusive
+            // registration cannot be modified, so these go through DEL+ADD
+            event.data.fd = fd;
+            event.events = eventMask(socketFlags(fd));
+            res = -1;
+            if ((event.events & EPOLLEXCLUSIVE) == 0) {
+                res = epoll_ctl(_epollfd, EPOLL_CTL_MOD, fd, &event);
+            }
+            if ((res != 0) && ((event.events & EPOLLEXCLUSIVE) != 0 || errno == EINVAL)) {
+                epoll_ctl(_epollfd, EPOLL_CTL_DEL, fd, nullptr);
+                res = epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &event);
+            }
+            if (res != 0) {
+                perror("EpollReactor::onSocketOps() on epoll_ctl(MOD)");
+            }
+            break;
         case Operation::Removed:
             // Tells the kernel we do not need to be notified by this socket anymore
             res = epoll_ctl(_epollfd, EPOLL_CTL_DEL, fd, nullptr);
@@ -85,7 +214,6 @@ void EpollReactor::onSocketOps(int fd, Operation ops) {
                 }
             }
             break;
-        case Operation::Modified:
         case Operation::NA: break;
     }
 }
@@ -3,11 +3,35 @@
 #include "DateTime.h"
 #include "Reactor.h"
 
+// Defined in <sys/epoll.h>, which we keep out of the header
+struct epoll_event;
+
 namespace hbthreads {
 
 //! An event dispatcher based on the Posix epoll mechanism
+//! Subscription flags map to EPOLLET, EPOLLONESHOT and EPOLLEXCLUSIVE. Oneshot
+//! sockets stay quiet after their event until a subscriber calls `rearm(fd)`.
 class EpollReactor : public Reactor {
 public:
+    //! Decides how `work()` waits for events when latency matters more than cpu.
+    //! After the last event the reactor spins on non-blocking polls for `spin`,
+    //! then keeps polling with `pause_count` cpu pauses between polls for `pause`
+    //! and only then blocks for the reactor timeout. A busy reactor stays hot while
+    //! an idle one settles back into blocking. The default policy never spins.
+    struct SpinPolicy {
+        DateTime spin;                   //! Time to spin on non-blocking polls
+        DateTime pause;                  //! Time to poll with pauses in between
+        std::uint32_t pause_count = 16;  //! Number of cpu pauses between polls
+        DateTime busy_poll;  //! Kernel busy polling per epoll_wait(), zero disables
+    };
+
+    //! Counters of epoll_wait() outcomes, cumulative over the reactor life
+    struct PollCounters {
+        std::uint64_t productive = 0;  //! polls that returned events
+        std::uint64_t empty = 0;       //! polls that returned nothing
+        std::uint64_t blocked = 0;     //! times spinning gave up and blocked
+    };
+
     //! Creates the epoll file descriptor
     //! timeout is the amount to block for events until `work()` returns
     //! max_events is the size of the event buffer (default 256, suitable for HFT)
@@ -22,13 +46,38 @@ public:
     //! Returns false if something bad happened to the file descriptor
     bool work();
 
+    //! Replaces the spin policy. Kernel busy polling (EPOLL_IOC_BUSY_POLL) is
+    //! configured on the epoll descriptor if requested; returns false if the
+    //! kernel does not support it or refused it, the rest of the policy applies.
+    bool setSpinPolicy(const SpinPolicy& policy);
+
+    //! Returns the current spin policy
+    const SpinPolicy& spinPolicy() const noexcept {
+        return _spin;
+    }
+
+    //! Returns the poll counters
+    const PollCounters& counters() const noexcept {
+        return _counters;
+    }
+
 private:
     //! manages the socket
     void onSocketOps(int fd, Operation ops) override;
 
+    //! Polls without blocking until events show up or the spin window since
+    //! the last event runs out, then blocks for `timeout_ms`
+    int spinWait(epoll_event* events, int timeout_ms);
+
+    //! Calls epoll_wait() once and updates the counters
+    int waitEvents(epoll_event* events, int timeout_ms);
+
     DateTime _timeout;   //! How long should we block waiting for events?
     int _epollfd;        //! epoll file descriptor
     int _max_events;     //! Maximum events to process per work() call
+    SpinPolicy _spin;    //! How to wait for events
+    PollCounters _counters;  //! What happened to our polls
+    DateTime _last_event;    //! Monotonic time of the last productive spin poll
 };
 
-}  // namespace hbthreads
\ No newline at end of file
+}  // namespace hbthreads
@@ -2,6 +2,7 @@
 #include "EpollReactor.h"
 #include "LightThread.h"
 #include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 using namespace hbthreads;
@@ -22,6 +23,82 @@ public:
     }
 };
 
+namespace {
+
+// Fills its socket and then waits for room to write
+class WriterThread : public LightThread {
+public:
+    WriterThread(int fd) : fd(fd) {
+    }
+    int fd;
+    bool blocked = false;
+    bool writable = false;
+
+    void run() override {
+        char buf[4096] = {};
+        while (::write(fd, buf, sizeof(buf)) > 0) {
+        }
+        blocked = true;
+        writable = awaitWritable(fd);
+    }
+};
+
+// Waits on its socket with a deadline, over and over
+class DeadlineThread : public LightThread {
+public:
+    DeadlineThread(int fd, DateTime timeout) : fd(fd), timeout(timeout) {
+    }
+    int fd;
+    DateTime timeout;
+    std::vector<EventType> results;
+
+    void run() override {
+        while (true) {
+            EventType type = waitFd(fd, timeout);
+            results.push_back(type);
+            if (type == EventType::SocketRead) {
+                eventfd_t value;
+                eventfd_read(fd, &value);
+            }
+        }
+    }
+};
+
+// Waits with a deadline, recording what woke it up
+class TimedWaitThread : public LightThread {
+public:
+    std::vector<EventType> results;
+
+    void run() override {
+        while (true) {
+            results.push_back(wait(DateTime::msecs(5))->type);
+        }
+    }
+};
+
+// Waits briefly and then on its socket, recording what ended each wait
+class TwoWaitsThread : public LightThread {
+public:
+    TwoWaitsThread(int fd) : fd(fd) {
+    }
+    int fd;
+    std::vector<EventType> results;
+
+    void run() override {
+        results.push_back(wait(DateTime::msecs(1))->type);
+        results.push_back(waitFd(fd, DateTime::secs(10)));
+    }
+};
+
+// Reads everything pending on a non-blocking socket
+void drainSocket(int fd) {
+    char buf[4096];
+    while (::read(fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+}  // namespace
+
 class EpollReactorTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -278,4 +355,314 @@ TEST_F(EpollReactorTest, RepeatedAddRemove) {
     }
 
     close(fd);
-}
\ No newline at end of file
+}
+TEST_F(EpollReactorTest, DefaultPolicyDoesNotSpin) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    EXPECT_TRUE(reactor.work());
+    EXPECT_EQ(reactor.counters().empty, 1UL);
+    EXPECT_EQ(reactor.counters().productive, 0UL);
+    EXPECT_EQ(reactor.counters().blocked, 0UL);
+}
+
+TEST_F(EpollReactorTest, SpinPolicyFallsBackToBlocking) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    EpollReactor::SpinPolicy policy;
+    policy.spin = DateTime::usecs(200);
+    policy.pause = DateTime::usecs(200);
+    EXPECT_TRUE(reactor.setSpinPolicy(policy));
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+    reactor.monitor(fd, thread.get());
+
+    // Pending events are picked up by the first non-blocking poll
+    uint64_t val = 1;
+    write(fd, &val, sizeof(val));
+    EXPECT_TRUE(reactor.work());
+    EXPECT_EQ(thread->events_received, 1);
+    EXPECT_EQ(reactor.counters().productive, 1UL);
+    EXPECT_EQ(reactor.counters().blocked, 0UL);
+
+    // The eventfd was not drained so it fires again right away
+    EXPECT_TRUE(reactor.work());
+    EXPECT_EQ(thread->events_received, 2);
+    EXPECT_EQ(reactor.counters().blocked, 0UL);
+
+    // Drain it - now the reactor spins through the window and then blocks
+    read(fd, &val, sizeof(val));
+    EXPECT_TRUE(reactor.work());
+    EXPECT_EQ(thread->events_received, 2);
+    EXPECT_GT(reactor.counters().empty, 1UL);
+    EXPECT_EQ(reactor.counters().blocked, 1UL);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, LevelTriggeredRepeatsUndrainedEvents) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get());
+
+    // The thread does not read so the socket keeps being reported
+    uint64_t val = 1;
+    write(fd, &val, sizeof(val));
+    reactor.work();
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 2);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, EdgeTriggeredReportsOnlyNewData) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get(), MonitorFlags::EdgeTriggered);
+
+    uint64_t val = 1;
+    write(fd, &val, sizeof(val));
+    reactor.work();
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 1);
+
+    // New data is a new edge
+    write(fd, &val, sizeof(val));
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 2);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, OneShotUntilRearmed) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get(), MonitorFlags::OneShot);
+
+    // Reported once even though the socket was not drained
+    uint64_t val = 1;
+    write(fd, &val, sizeof(val));
+    reactor.work();
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 1);
+
+    // Re-arming reports the pending data again
+    reactor.rearm(fd);
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 2);
+
+    // Once drained there is nothing more to report
+    read(fd, &val, sizeof(val));
+    reactor.rearm(fd);
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 2);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, ExclusiveSubscription) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread1(new TestThread);
+    Pointer<TestThread> thread2(new TestThread);
+    thread1->start(4 * 1024);
+    thread2->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread1.get());
+    reactor.monitor(fd, thread2.get(), MonitorFlags::Exclusive);
+
+    // Switching to exclusive re-registers the socket, which keeps working
+    uint64_t val = 1;
+    write(fd, &val, sizeof(val));
+    reactor.work();
+    EXPECT_EQ(thread1->events_received, 1);
+    EXPECT_EQ(thread2->events_received, 1);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, FlagsFollowSubscriptions) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread1(new TestThread);
+    Pointer<TestThread> thread2(new TestThread);
+    thread1->start(4 * 1024);
+    thread2->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread1.get());
+    reactor.monitor(fd, thread2.get(), MonitorFlags::EdgeTriggered);
+
+    // One edge triggered subscriber turns the socket edge triggered
+    uint64_t val = 1;
+    write(fd, &val, sizeof(val));
+    reactor.work();
+    reactor.work();
+    EXPECT_EQ(thread1->events_received, 1);
+
+    // Back to level triggered when it leaves
+    reactor.removeThread(thread2.get());
+    reactor.work();
+    EXPECT_EQ(thread1->events_received, 2);
+
+    // Resubscribing with other flags replaces the previous ones
+    // Modifying a ready socket reports it once more
+    reactor.monitor(fd, thread1.get(), MonitorFlags::EdgeTriggered);
+    reactor.work();
+    reactor.work();
+    EXPECT_EQ(thread1->events_received, 3);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, NoWritableEventsUnlessAsked) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    reactor.monitor(fds[0], thread.get());
+
+    // The socket has room to write all along but nobody asked
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 0);
+
+    reactor.removeSocket(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(EpollReactorTest, AwaitWritable) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    Pointer<WriterThread> thread(new WriterThread(fds[0]));
+    reactor.monitor(fds[0], thread.get());
+    thread->start(16 * 1024);
+    ASSERT_TRUE(thread->blocked);
+
+    // Still full
+    reactor.work();
+    EXPECT_FALSE(thread->writable);
+
+    // Make room, the writer gets its event and finishes
+    drainSocket(fds[1]);
+    reactor.work();
+    EXPECT_TRUE(thread->writable);
+    EXPECT_FALSE(reactor.active());
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(EpollReactorTest, WaitWithTimeout) {
+    EpollReactor reactor(buffer, DateTime::secs(1));
+    Pointer<TimedWaitThread> thread(new TimedWaitThread);
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get());
+    thread->start(16 * 1024);
+
+    // Nothing happens, the timer fires without waiting for the reactor timeout
+    DateTime start = DateTime::now(DateTime::ClockType::Monotonic);
+    while (thread->results.empty()) {
+        reactor.work();
+    }
+    DateTime elapsed = DateTime::now(DateTime::ClockType::Monotonic) - start;
+    EXPECT_EQ(thread->results[0], EventType::Timeout);
+    EXPECT_GE(elapsed.msecs(), 4);
+    EXPECT_LT(elapsed.msecs(), 500);
+
+    // The socket comes first and the timer is cancelled, only the new one is left
+    eventfd_write(fd, 1);
+    reactor.work();
+    ASSERT_EQ(thread->results.size(), 2UL);
+    EXPECT_EQ(thread->results[1], EventType::SocketRead);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(EpollReactorTest, WaitFdWithTimeout) {
+    EpollReactor reactor(buffer, DateTime::secs(1));
+    int fd = eventfd(0, EFD_NONBLOCK);
+    int other = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    ASSERT_GE(other, 0);
+    Pointer<DeadlineThread> thread(new DeadlineThread(fd, DateTime::msecs(5)));
+
+    // Subscribed with flags of its own, waitFd() keeps them
+    reactor.monitor(other, thread.get());
+    reactor.monitor(fd, thread.get(), MonitorFlags::EdgeTriggered);
+    thread->start(16 * 1024);
+
+    // Events elsewhere do not wake it up
+    eventfd_write(other, 1);
+    while (thread->results.empty()) {
+        reactor.work();
+    }
+    EXPECT_EQ(thread->results[0], EventType::Timeout);
+
+    eventfd_write(fd, 1);
+    while (thread->results.size() < 2) {
+        reactor.work();
+    }
+    EXPECT_EQ(thread->results[1], EventType::SocketRead);
+    EXPECT_TRUE(reactor.isMonitoring(fd, thread.get()));
+    EXPECT_FALSE(reactor.isMonitoring(fd + other + 1, thread.get()));
+
+    reactor.removeThread(thread.get());
+    close(fd);
+    close(other);
+}
+
+TEST_F(EpollReactorTest, StaleTimeoutDoesNotEndNextWait) {
+    EpollReactor reactor(buffer, DateTime::msecs(1));
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    Pointer<TwoWaitsThread> thread(new TwoWaitsThread(fd));
+    reactor.monitor(fd, thread.get());
+    thread->start(16 * 1024);
+
+    // The first timer expires behind a wakeup, which ends the first wait. The
+    // socket wait then gets a timer in the same slot
+    usleep(3000);
+    Event event;
+    event.type = EventType::Wakeup;
+    event.fd = -1;
+    reactor.post(thread.get(), event, RunPriority::High);
+    reactor.work();
+    ASSERT_EQ(thread->results.size(), 1UL);
+    EXPECT_EQ(thread->results[0], EventType::Wakeup);
+
+    // The Timeout of the first timer was queued already, it is not for this wait
+    reactor.work();
+    EXPECT_EQ(thread->results.size(), 1UL);
+    eventfd_write(fd, 1);
+    reactor.work();
+    ASSERT_EQ(thread->results.size(), 2UL);
+    EXPECT_EQ(thread->results[1], EventType::SocketRead);
+    EXPECT_TRUE(thread->finished());
+    close(fd);
+}
@@ -4,6 +4,7 @@
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 #include <boost/container/flat_set.hpp>
 #include <boost/container/flat_map.hpp>
+#include <boost/container/vector.hpp>
 #include <boost/container/pmr/vector.hpp>
 #include <boost/container/pmr/small_vector.hpp>
 #include <boost/container/pmr/unsynchronized_pool_resource.hpp>
@@ -80,6 +81,18 @@ struct FlatMap : public BoostFlatMap<Key, Type, Comp> {
     }
 };
 
+//! This is to save us some typing
+template <typename Type>
+using BoostVector = boost::container::vector<Type, Allocator<Type>>;
+
+//! This wrapper will prevent the creation of an internal pool and waste time
+template <typename Type>
+struct Vector : BoostVector<Type> {
+    using allocator_type = typename BoostVector<Type>::allocator_type;
+    Vector(MemoryStorage *pool) : BoostVector<Type>(allocator_type(pool)) {
+    }
+};
+
 template <typename Type, size_t N>
 using BoostSmallVector = boost::container::small_vector<Type, N, Allocator<Type>>;
 
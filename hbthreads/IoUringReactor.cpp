@@ -0,0 +1,377 @@
+#include "IoUringReactor.h"
+#include <linux/io_uring.h>
+#include <algorithm>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace hbthreads;
+
+// Completions of removal requests are tagged with this so we can ignore them
+static constexpr std::uint64_t RemoveTag = ~0ULL;
+
+// Events we are interested in, the same set the EpollReactor asks for
+static constexpr unsigned PollMask = POLLIN | POLLRDHUP | POLLPRI | POLLERR;
+
+// Only asked for while a thread waits for room to write
+static constexpr unsigned PollWriteMask = POLLOUT;
+
+// A poll request is identified by the socket and its generation
+static inline std::uint64_t makeTag(int fd, std::uint32_t generation) {
+    return (std::uint64_t(generation) << 32) | std::uint32_t(fd);
+}
+
+// There is no glibc wrapper for these so we go straight to the kernel
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return (int)::syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags, void* arg, std::size_t argsz) {
+    return (int)::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg,
+                          argsz);
+}
+
+// Pointer to a field inside a ring mapping
+template <typename T>
+static inline T* ringField(void* base, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<std::uint8_t*>(base) + offset);
+}
+
+IoUringReactor::IoUringReactor(MemoryStorage* mem, DateTime timeout,
+                               unsigned queue_depth)
+    : Reactor(mem),
+      _timeout(timeout),
+      _ringfd(-1),
+      _sq_head(nullptr),
+      _sq_tail(nullptr),
+      _sq_mask(nullptr),
+      _sq_array(nullptr),
+      _sqes(nullptr),
+      _sq_local_tail(0),
+      _cq_head(nullptr),
+      _cq_tail(nullptr),
+      _cq_mask(nullptr),
+      _cqes(nullptr),
+      _sq_ptr(MAP_FAILED),
+      _sq_size(0),
+      _cq_ptr(MAP_FAILED),
+      _cq_size(0),
+      _sqes_size(0),
+      _level_poll(false),
+      _generations(mem) {
+    assert(mem != nullptr && "MemoryStorage must not be null");
+    assert(queue_depth > 0 && "queue_depth must be positive");
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+#ifdef IORING_SETUP_SINGLE_ISSUER
+    // Only this thread touches the ring, and it is fine for the kernel to
+    // run completion work when we enter instead of interrupting us
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    _ringfd = io_uring_setup(queue_depth, &params);
+    if ((_ringfd < 0) && (errno == EINVAL)) {
+        // Older kernel - go without the hints
+        memset(&params, 0, sizeof(params));
+        _ringfd = io_uring_setup(queue_depth, &params);
+    }
+#else
+    _ringfd = io_uring_setup(queue_depth, &params);
+#endif
+    if (_ringfd < 0) {
+        perror("IoUringReactor::IoUringReactor() on io_uring_setup");
+        return;
+    }
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0) {
+        fprintf(stderr, "IoUringReactor: kernel does not support wait timeouts\n");
+        ::close(_ringfd);
+        _ringfd = -1;
+        return;
+    }
+
+    // Map the rings. Newer kernels let us map both with a single call
+    _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        _sq_size = std::max(_sq_size, _cq_size);
+        _cq_size = _sq_size;
+    }
+    _sq_ptr = ::mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQ_RING);
+    if (_sq_ptr == MAP_FAILED) {
+        perror("IoUringReactor::IoUringReactor() on mmap(SQ)");
+        ::close(_ringfd);
+        _ringfd = -1;
+        return;
+    }
+    if (single_mmap) {
+        _cq_ptr = _sq_ptr;
+    } else {
+        _cq_ptr = ::mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_CQ_RING);
+        if (_cq_ptr == MAP_FAILED) {
+            perror("IoUringReactor::IoUringReactor() on mmap(CQ)");
+            ::close(_ringfd);
+            _ringfd = -1;
+            return;
+        }
+    }
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        perror("IoUringReactor::IoUringReactor() on mmap(SQES)");
+        ::close(_ringfd);
+        _ringfd = -1;
+        return;
+    }
+    _sqes = static_cast<io_uring_sqe*>(sqes);
+
+    _sq_head = ringField<unsigned>(_sq_ptr, params.sq_off.head);
+    _sq_tail = ringField<unsigned>(_sq_ptr, params.sq_off.tail);
+    _sq_mask = ringField<unsigned>(_sq_ptr, params.sq_off.ring_mask);
+    _sq_array = ringField<unsigned>(_sq_ptr, params.sq_off.array);
+    _sq_local_tail = *_sq_tail;
+    _cq_head = ringField<unsigned>(_cq_ptr, params.cq_off.head);
+    _cq_tail = ringField<unsigned>(_cq_ptr, params.cq_off.tail);
+    _cq_mask = ringField<unsigned>(_cq_ptr, params.cq_off.ring_mask);
+    _cqes = ringField<io_uring_cqe>(_cq_ptr, params.cq_off.cqes);
+    _level_poll = probeLevelPoll();
+}
+
+// Unmaps whatever got mapped and closes the ring
+IoUringReactor::~IoUringReactor() {
+    if (_sqes != nullptr) ::munmap(_sqes, _sqes_size);
+    if ((_cq_ptr != MAP_FAILED) && (_cq_ptr != _sq_ptr)) ::munmap(_cq_ptr, _cq_size);
+    if (_sq_ptr != MAP_FAILED) ::munmap(_sq_ptr, _sq_size);
+    if (_ringfd >= 0) ::close(_ringfd);
+}
+
+io_uring_sqe* IoUringReactor::getSqe() {
+    unsigned entries = *_sq_mask + 1;
+    unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (_sq_local_tail - head >= entries) {
+        // Ring is full - hand what we have to the kernel
+        if (enter(0, DateTime::zero()) < 0) {
+            perror("IoUringReactor::getSqe() on io_uring_enter");
+        }
+        head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (_sq_local_tail - head >= entries) return nullptr;
+    }
+    unsigned index = _sq_local_tail & *_sq_mask;
+    _sq_array[index] = index;
+    _sq_local_tail += 1;
+    io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUringReactor::enter(unsigned min_complete, DateTime timeout) {
+    // Publish our submissions
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if ((to_submit == 0) && (min_complete == 0)) return 0;
+
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void* argp = nullptr;
+    std::size_t argsz = 0;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        // Negative timeouts block until something happens
+        if (timeout.nsecs() >= 0) {
+            ts.tv_sec = timeout.secs();
+            ts.tv_nsec = timeout.nanos();
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+    }
+    int res = io_uring_enter(_ringfd, to_submit, min_complete, flags, argp, argsz);
+    if (res < 0) {
+        // Timeouts, signals and a full completion ring are not errors
+        if ((errno == ETIME) || (errno == EINTR) || (errno == EBUSY) ||
+            (errno == EAGAIN)) {
+            return 0;
+        }
+    }
+    return res;
+}
+
+bool IoUringReactor::work() {
+    if (_ringfd < 0) return false;
+
+    // Do not block if there are completions or threads waiting already
+    unsigned ready = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE) - *_cq_head;
+    DateTime timeout = pollTimeout(_timeout);
+    bool busy = (ready > 0) || runnable() || (timeout.nsecs() == 0);
+    unsigned min_complete = busy ? 0 : 1;
+    if (enter(min_complete, timeout) < 0) {
+        perror("IoUringReactor::work() on io_uring_enter");
+        return false;
+    }
+
+    // Reap everything that is available now
+    unsigned head = *_cq_head;
+    unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        io_uring_cqe cqe = _cqes[head & *_cq_mask];
+        // Release the entry before dispatching as threads might submit more work
+        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+        dispatch(cqe);
+    }
+    flushEvents();
+
+    // Posted threads and expired timers, their submissions go with the next call
+    runQueued();
+    return true;
+}
+
+void IoUringReactor::dispatch(const io_uring_cqe& cqe) {
+    if (cqe.user_data == RemoveTag) return;
+
+    // Drop completions from requests that were cancelled
+    int fd = int(cqe.user_data & 0xFFFFFFFFULL);
+    std::uint32_t generation = cqe.user_data >> 32;
+    if ((fd >= int(_generations.size())) || (_generations[fd] != generation)) return;
+
+    if (cqe.res < 0) {
+        deliverEvent(fd, EventType::SocketError);
+        return;
+    }
+    unsigned events = cqe.res;
+    // Notify reads
+    if ((events & POLLIN) != 0) {
+        deliverEvent(fd, EventType::SocketRead);
+    }
+    // Notify room to write
+    if ((events & POLLOUT) != 0) {
+        deliverEvent(fd, EventType::SocketWriteable);
+    }
+    // Notify errors
+    if ((events & POLLERR) != 0) {
+        deliverEvent(fd, errorEvent(fd));
+    }
+    // Notify hangup
+    if ((events & POLLHUP) != 0) {
+        deliverEvent(fd, EventType::SocketHangup);
+    }
+
+    // One-shot polls and multishot requests the kernel terminated. Rearm if still wanted
+    if (((cqe.flags & IORING_CQE_F_MORE) == 0) && (_generations[fd] == generation)) {
+        armPoll(fd);
+    }
+}
+
+bool IoUringReactor::probeLevelPoll() {
+#ifdef IORING_POLL_ADD_LEVEL
+    // Poll an eventfd that is readable from the start. Kernels that do not know
+    // the flag fail the request, the others complete it right away
+    int fd = ::eventfd(1, EFD_NONBLOCK);
+    if (fd < 0) return false;
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI | IORING_POLL_ADD_LEVEL;
+    sqe->user_data = RemoveTag;
+    bool supported = false;
+    if (enter(1, DateTime::msecs(100)) >= 0) {
+        unsigned head = *_cq_head;
+        if (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+            supported = _cqes[head & *_cq_mask].res >= 0;
+            __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+        }
+    }
+    if (supported) {
+        // Its cancellation completes later and is dropped with the other removals
+        sqe = getSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = RemoveTag;
+        sqe->user_data = RemoveTag;
+        enter(0, DateTime::zero());
+    }
+    ::close(fd);
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void IoUringReactor::armPoll(int fd) {
+    io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        fprintf(stderr, "IoUringReactor::armPoll(): submission ring is full\n");
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = PollMask;
+    MonitorFlags flags = socketFlags(fd);
+    if (hasFlags(flags, MonitorFlags::Writable)) {
+        sqe->poll32_events |= PollWriteMask;
+    }
+    if (hasFlags(flags, MonitorFlags::EdgeTriggered)) {
+        // Plain multishot polls only fire on new data
+        sqe->len = IORING_POLL_ADD_MULTI;
+    } else if (_level_poll) {
+#ifdef IORING_POLL_ADD_LEVEL
+        sqe->len = IORING_POLL_ADD_MULTI | IORING_POLL_ADD_LEVEL;
+#endif
+    }
+    // Otherwise a one-shot poll, dispatch() arms it again after it completes
+    sqe->user_data = makeTag(fd, _generations[fd]);
+}
+
+void IoUringReactor::cancelPoll(int fd) {
+    // Cancel the current request and forget about its completions
+    if (fd >= int(_generations.size())) return;
+    io_uring_sqe* sqe = getSqe();
+    if (sqe == nullptr) {
+        fprintf(stderr, "IoUringReactor::cancelPoll(): submission ring is full\n");
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeTag(fd, _generations[fd]);
+    sqe->user_data = RemoveTag;
+    _generations[fd] += 1;
+}
+
+void IoUringReactor::onSocketOps(int fd, Operation ops) {
+    // Sanity check
+    if (_ringfd < 0) return;
+
+    switch (ops) {
+        case Operation::Added:
+            // A new generation so leftovers from previous requests are ignored
+            if (fd >= int(_generations.size())) {
+                _generations.resize(fd + 1, 0);
+            }
+            _generations[fd] += 1;
+            armPoll(fd);
+            break;
+        case Operation::Removed:
+            cancelPoll(fd);
+            break;
+        case Operation::Modified:
+            // Replace the request by one with the new event mask
+            if (fd >= int(_generations.size())) break;
+            cancelPoll(fd);
+            armPoll(fd);
+            break;
+        case Operation::NA: break;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "DateTime.h"
+#include "Reactor.h"
+
+// Defined in <linux/io_uring.h>, which we keep out of the header like epoll
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace hbthreads {
+
+//! An event dispatcher based on the Linux io_uring interface
+//! Edge triggered sockets are watched with one multishot poll request, which
+//! keeps firing on new data until it is cancelled so they are armed only once.
+//! Level triggered sockets use a level multishot poll where the kernel has one,
+//! otherwise a one-shot poll re-armed after every completion, which completes
+//! again right away while data is left unread - as epoll does. Registrations and
+//! removals are queued in the submission ring and handed to the kernel in the
+//! same io_uring_enter() call that waits for completions, so a single syscall
+//! per `work()` submits all pending changes and reaps all ready sockets.
+//! The ring keeps its own reference to polled files so sockets should be
+//! removed from the reactor before they are closed.
+class IoUringReactor : public Reactor {
+public:
+    //! Creates and maps the rings
+    //! timeout is the amount to block for events until `work()` returns
+    //! queue_depth is the number of submission entries (completions get twice that)
+    IoUringReactor(MemoryStorage* mem, DateTime timeout = DateTime::nsecs(-1),
+                   unsigned queue_depth = 256);
+
+    //! Unmaps the rings and closes the descriptor
+    ~IoUringReactor();
+
+    //! Submits pending registrations, waits for completions and dispatches them.
+    //! Returns false if something bad happened to the ring
+    bool work();
+
+private:
+    //! manages the socket
+    void onSocketOps(int fd, Operation ops) override;
+
+    //! Returns the next free submission entry, flushing the ring if full
+    io_uring_sqe* getSqe();
+
+    //! Queues a poll request for this socket as its flags ask for
+    void armPoll(int fd);
+
+    //! Returns true if the kernel takes level triggered multishot polls
+    bool probeLevelPoll();
+
+    //! Queues the cancellation of the current poll request of this socket
+    void cancelPoll(int fd);
+
+    //! Calls io_uring_enter() with the pending submissions.
+    //! Waits up to `timeout` for at least `min_complete` completions
+    int enter(unsigned min_complete, DateTime timeout);
+
+    //! Processes one completion entry
+    void dispatch(const io_uring_cqe& cqe);
+
+    DateTime _timeout;  //! How long should we block waiting for events?
+    int _ringfd;        //! io_uring file descriptor
+
+    // Submission ring - pointers into the shared mapping
+    unsigned* _sq_head;     //! consumed by the kernel
+    unsigned* _sq_tail;     //! produced by us
+    unsigned* _sq_mask;     //! ring size minus one
+    unsigned* _sq_array;    //! indirection array into `_sqes`
+    io_uring_sqe* _sqes;    //! the submission entries
+    unsigned _sq_local_tail;  //! our tail, published to the kernel on enter()
+
+    // Completion ring - pointers into the shared mapping
+    unsigned* _cq_head;   //! consumed by us
+    unsigned* _cq_tail;   //! produced by the kernel
+    unsigned* _cq_mask;   //! ring size minus one
+    io_uring_cqe* _cqes;  //! the completion entries
+
+    // Mappings so we can release them
+    void* _sq_ptr;
+    std::size_t _sq_size;
+    void* _cq_ptr;
+    std::size_t _cq_size;
+    std::size_t _sqes_size;
+
+    //! Level triggered sockets can use multishot polls
+    bool _level_poll;
+
+    //! Generation of the current poll request of each socket
+    //! Completions of cancelled requests carry an old generation and are dropped
+    Vector<std::uint32_t> _generations;
+};
+
+}  // namespace hbthreads
@@ -0,0 +1,297 @@
+#include <gtest/gtest.h>
+#include "IoUringReactor.h"
+#include "LightThread.h"
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace hbthreads;
+
+namespace {
+
+// Test thread that records events, consuming the eventfd counter
+class TestThread : public LightThread {
+public:
+    int events_received = 0;
+    std::vector<EventType> event_types;
+    std::vector<int> event_fds;
+
+    void run() override {
+        while (true) {
+            Event* ev = wait();
+            events_received++;
+            event_types.push_back(ev->type);
+            event_fds.push_back(ev->fd);
+            eventfd_t value;
+            eventfd_read(ev->fd, &value);
+        }
+    }
+};
+
+// Test thread that records events but leaves the data where it is
+class PeekThread : public LightThread {
+public:
+    int events_received = 0;
+
+    void run() override {
+        while (true) {
+            wait();
+            events_received++;
+        }
+    }
+};
+
+// Fills its socket and then waits for room to write
+class WriterThread : public LightThread {
+public:
+    WriterThread(int fd) : fd(fd) {
+    }
+    int fd;
+    bool blocked = false;
+    bool writable = false;
+
+    void run() override {
+        char buf[4096] = {};
+        while (::write(fd, buf, sizeof(buf)) > 0) {
+        }
+        blocked = true;
+        writable = awaitWritable(fd);
+    }
+};
+
+// Reads everything pending on a non-blocking socket
+void drainSocket(int fd) {
+    char buf[4096];
+    while (::read(fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+}  // namespace
+
+class IoUringReactorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+    }
+
+    void TearDown() override {
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+};
+
+TEST_F(IoUringReactorTest, Constructor) {
+    IoUringReactor reactor(buffer);
+    EXPECT_FALSE(reactor.active());
+}
+
+TEST_F(IoUringReactorTest, WorkWithoutSubscriptions) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+    EXPECT_TRUE(reactor.work());
+}
+
+TEST_F(IoUringReactorTest, BasicEventDispatching) {
+    IoUringReactor reactor(buffer, DateTime::msecs(10));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(16 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get());
+
+    eventfd_write(fd, 1);
+    EXPECT_TRUE(reactor.work());
+
+    ASSERT_EQ(thread->events_received, 1);
+    EXPECT_EQ(thread->event_types[0], EventType::SocketRead);
+    EXPECT_EQ(thread->event_fds[0], fd);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(IoUringReactorTest, MultishotKeepsFiring) {
+    IoUringReactor reactor(buffer, DateTime::msecs(10));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(16 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get());
+
+    // Every write is reported, whatever kind of poll request watches the socket
+    for (int j = 0; j < 10; ++j) {
+        eventfd_write(fd, 1);
+        reactor.work();
+    }
+    EXPECT_EQ(thread->events_received, 10);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(IoUringReactorTest, LevelTriggeredRepeatsUndrainedEvents) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<PeekThread> thread(new PeekThread);
+    thread->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get());
+
+    // The thread does not read so the socket is reported on every call, like epoll
+    eventfd_write(fd, 1);
+    for (int j = 0; j < 5; ++j) {
+        reactor.work();
+    }
+    EXPECT_EQ(thread->events_received, 5);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(IoUringReactorTest, EdgeTriggeredReportsOnlyNewData) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<PeekThread> thread(new PeekThread);
+    thread->start(4 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get(), MonitorFlags::EdgeTriggered);
+
+    eventfd_write(fd, 1);
+    for (int j = 0; j < 5; ++j) {
+        reactor.work();
+    }
+    EXPECT_EQ(thread->events_received, 1);
+
+    // New data is a new edge
+    eventfd_write(fd, 1);
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 2);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(IoUringReactorTest, ManyEventsInOneWork) {
+    IoUringReactor reactor(buffer, DateTime::msecs(10));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(16 * 1024);
+
+    const int NUM_FDS = 100;
+    int fds[NUM_FDS];
+    for (int& fd : fds) {
+        fd = eventfd(0, EFD_NONBLOCK);
+        ASSERT_GE(fd, 0);
+        reactor.monitor(fd, thread.get());
+    }
+
+    // Registrations are submitted together with the first wait
+    reactor.work();
+    for (int fd : fds) {
+        eventfd_write(fd, 1);
+    }
+    reactor.work();
+    EXPECT_EQ(thread->events_received, NUM_FDS);
+
+    for (int fd : fds) {
+        reactor.removeSocket(fd);
+        close(fd);
+    }
+}
+
+TEST_F(IoUringReactorTest, NoEventsAfterRemove) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(16 * 1024);
+
+    int fd1 = eventfd(0, EFD_NONBLOCK);
+    int fd2 = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd1, 0);
+    ASSERT_GE(fd2, 0);
+    reactor.monitor(fd1, thread.get());
+    reactor.monitor(fd2, thread.get());
+    reactor.work();
+
+    reactor.removeSocket(fd1);
+    eventfd_write(fd1, 1);
+    eventfd_write(fd2, 1);
+    reactor.work();
+    reactor.work();
+
+    ASSERT_EQ(thread->events_received, 1);
+    EXPECT_EQ(thread->event_fds[0], fd2);
+
+    reactor.removeSocket(fd2);
+    close(fd1);
+    close(fd2);
+}
+
+TEST_F(IoUringReactorTest, RepeatedAddRemove) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(16 * 1024);
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+
+    for (int i = 0; i < 10; i++) {
+        reactor.monitor(fd, thread.get());
+        EXPECT_TRUE(reactor.active());
+        eventfd_write(fd, 1);
+        reactor.work();
+        reactor.removeSocket(fd);
+        EXPECT_FALSE(reactor.active());
+    }
+    EXPECT_EQ(thread->events_received, 10);
+    close(fd);
+}
+
+TEST_F(IoUringReactorTest, NoWritableEventsUnlessAsked) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    reactor.monitor(fds[0], thread.get());
+
+    // The socket has room to write all along but nobody asked
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 0);
+
+    reactor.removeSocket(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(IoUringReactorTest, AwaitWritable) {
+    IoUringReactor reactor(buffer, DateTime::msecs(1));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    Pointer<WriterThread> thread(new WriterThread(fds[0]));
+    reactor.monitor(fds[0], thread.get());
+    thread->start(16 * 1024);
+    ASSERT_TRUE(thread->blocked);
+
+    // Still full
+    reactor.work();
+    EXPECT_FALSE(thread->writable);
+
+    // Make room, the writer gets its event and finishes
+    drainSocket(fds[1]);
+    reactor.work();
+    EXPECT_TRUE(thread->writable);
+    EXPECT_FALSE(reactor.active());
+
+    close(fds[0]);
+    close(fds[1]);
+}
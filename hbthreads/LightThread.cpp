@@ -1,17 +1,31 @@
 #include "LightThread.h"
 #include "Reactor.h"
+#include "StackPool.h"
 
 // You see how easy coroutines are once you strip down all the logic
 // from all these libraries. This is a strip naked implementation
 using namespace hbthreads;
 
-LightThread::LightThread() {
+// The thread being resumed on this OS thread, restored when it yields back
+static __thread LightThread* current_thread = nullptr;
+
+LightThread::LightThread()
+    : _stack_size(0),
+      _stack_pool(nullptr),
+      _reactor(nullptr),
+      _scheduler(nullptr),
+      _batch_count(0),
+      _batch_offset(0),
+      _wait_next(nullptr),
+      _wait_queued(false) {
 }
 
 LightThread::~LightThread() {
     // Deallocate stack if it was allocated
     // Note: No check for running thread - assumes proper lifecycle management
-    if (_stack_size > 0) {
+    if (_stack_pool != nullptr) {
+        _stack_pool->deallocate(_stack);
+    } else if (_stack_size > 0) {
         StackAllocator sa(_stack_size);
         sa.deallocate(_stack);
     }
@@ -25,6 +39,76 @@ Event* LightThread::wait() {
     return reinterpret_cast<Event*>(_ret.data);
 }
 
+Event* LightThread::wait(DateTime timeout) {
+    assert(_reactor != nullptr && "Thread must be subscribed to a reactor");
+    if (_reactor == nullptr) return wait();
+    Reactor* reactor = _reactor;
+    DateTime deadline = DateTime::now(DateTime::ClockType::Monotonic) + timeout;
+    Reactor::TimerId id = reactor->addTimer(this, deadline);
+    Event* event = wait();
+    // Timeouts always come on their own
+    if ((event->type != EventType::Timeout) || (event->timer != id)) {
+        reactor->cancelTimer(id);
+    }
+    return event;
+}
+
+EventType LightThread::waitFd(int fd, DateTime timeout) {
+    assert(_reactor != nullptr && "Thread must be subscribed to a reactor");
+    if (_reactor == nullptr) return EventType::NA;
+    Reactor* reactor = _reactor;
+    if (!reactor->isMonitoring(fd, this)) {
+        reactor->monitor(fd, this);
+    }
+    DateTime deadline = DateTime::now(DateTime::ClockType::Monotonic) + timeout;
+    Reactor::TimerId id = reactor->addTimer(this, deadline);
+    while (true) {
+        // Look into all events in case the reactor batches them
+        for (const Event& ev : *wait()) {
+            switch (ev.type) {
+                case EventType::Timeout:
+                    // Could be left over from another wait
+                    if (ev.timer == id) return EventType::Timeout;
+                    break;
+                case EventType::SocketRead:
+                case EventType::SocketWriteable:
+                case EventType::SocketError:
+                case EventType::SocketHangup:
+                case EventType::ErrorQueue:
+                    if (ev.fd == fd) {
+                        reactor->cancelTimer(id);
+                        return ev.type;
+                    }
+                    break;
+                case EventType::Wakeup:
+                case EventType::NA: break;
+            }
+        }
+    }
+}
+
+bool LightThread::awaitWritable(int fd) {
+    assert(_reactor != nullptr && "Thread must be subscribed to a reactor");
+    if (_reactor == nullptr) return false;
+    _reactor->monitorWritable(fd, this);
+    while (true) {
+        // Look into all events in case the reactor batches them
+        for (const Event& ev : *wait()) {
+            if (ev.fd != fd) continue;
+            switch (ev.type) {
+                case EventType::SocketWriteable: return true;
+                case EventType::SocketError:
+                case EventType::SocketHangup: return false;
+                case EventType::SocketRead:
+                case EventType::Wakeup:
+                case EventType::Timeout:
+                case EventType::ErrorQueue:
+                case EventType::NA: break;
+            }
+        }
+    }
+}
+
 void LightThread::entry(transfer_t ctx) {
     // This will get called by the coroutine infrastructure after jump_context call below
     // The pointer to the object is passed as a context data
@@ -43,9 +127,14 @@ void LightThread::entry(transfer_t ctx) {
 }
 
 bool LightThread::resume(Event* event) {
+    // Threads can resume each other so keep track of who was running
+    LightThread* previous = current_thread;
+    current_thread = this;
+
     // Will jump back to where the thread left, typically after the
     // first line in wait()
     _ret = jump_fcontext(_ret.fctx, event);
+    current_thread = previous;
 
     // Returns true if thread yielded (sent non-null data), false if completed (sent null)
     return (_ret.data != nullptr);
@@ -59,13 +148,25 @@ void LightThread::start(size_t stack_size) {
 
     _stack_size = stack_size;
 
-    // Allocate stack for this thread
-    StackAllocator sa(_stack_size);
-    _stack = sa.allocate();
+    // Allocate stack for this thread, preferably from the pool
+    if ((stack_pool != nullptr) && (stack_size <= StackPool::MaxStackSize)) {
+        _stack_pool = stack_pool;
+        _stack = _stack_pool->allocate(_stack_size);
+    } else {
+        StackAllocator sa(_stack_size);
+        _stack = sa.allocate();
+    }
 
     // Create execution context on the allocated stack
     _ctx = make_fcontext(_stack.sp, _stack.size, LightThread::entry);
 
     // Jump to the coroutine entry point, passing this object as context
+    LightThread* previous = current_thread;
+    current_thread = this;
     _ret = jump_fcontext(_ctx, (void*)this);
+    current_thread = previous;
+}
+
+LightThread* LightThread::current() {
+    return current_thread;
 }
@@ -13,29 +13,54 @@
 
 #pragma once
 
+#include "DateTime.h"
 #include "ImportedTypes.h"
+#include "IntrusiveIndexList.h"
 #include "Pointer.h"
 #include <cstdint>
 
 namespace hbthreads {
 
+// Forward declaration - the reactor keeps its subscriptions chained in the thread
+class Reactor;
+class StackPool;
+class WaitQueue;
+
 // Event types that can be delivered to waiting threads
 // Used by reactors to notify threads of I/O readiness or errors
 enum class EventType : uint16_t {
     NA = 0,               // Not applicable/uninitialized
     SocketRead = 1,       // Socket has data available for reading
-    SocketWriteable = 2,  // Socket is ready for writing (not currently implemented)
+    SocketWriteable = 2,  // Socket is ready for writing, see awaitWritable()
     SocketError = 3,      // Socket error occurred
-    SocketHangup = 4      // Socket connection closed/hung up
+    SocketHangup = 4,     // Socket connection closed/hung up
+    Wakeup = 5,           // Woken up by another thread, see ReactorGroup and CoSync.h
+    Timeout = 6,          // A timer expired, see Reactor::addTimer()
+    ErrorQueue = 7        // Socket error queue has messages, see MonitorFlags::ErrorQueue
 };
 
 // Event structure passed to resumed threads
-// Contains the event type and associated data (currently only file descriptor)
+// Contains the event type and associated data: the file descriptor, or the timer
+// id for Timeout events
+// A thread is resumed with an array of `count` events, which is just one unless
+// the reactor batches events. Iterating over the first event walks all of them:
+//     for (const Event& ev : *wait()) { ... }
 struct Event {
     EventType type;
+    std::uint32_t count = 1;  // Number of events delivered, only set in the first
     union {
-        int fd;  // File descriptor associated with the event
+        int fd;               // File descriptor associated with the event
+        std::uint64_t timer;  // Id of the timer that expired, see Reactor::addTimer()
     };
+    std::uint64_t tag = 0;    // Tag of the subscription, see Reactor::monitor()
+
+    // Range over all the events delivered with this one
+    const Event* begin() const {
+        return this;
+    }
+    const Event* end() const {
+        return this + count;
+    }
 };
 
 // Stack-full coroutine class providing cooperative multitasking
@@ -63,6 +88,23 @@ public:
     // The returned Event pointer contains details about what triggered the resume
     Event* wait();
 
+    // Same as wait() but gives up after `timeout`, returning a Timeout event.
+    // The thread must be subscribed to a reactor, which keeps the timer
+    Event* wait(DateTime timeout);
+
+    // Yield control until this socket has an event or `timeout` expires
+    // The thread must already be subscribed to a reactor and is subscribed to the
+    // socket if needed. Events of other sockets arriving in the meantime are dropped.
+    // Returns the type of the socket event or EventType::Timeout
+    EventType waitFd(int fd, DateTime timeout);
+
+    // Yield control until there is room to write on this socket
+    // The thread must already be subscribed to a reactor, which watches the socket
+    // for writability only until the event is delivered. Other events arriving in
+    // the meantime are dropped - level triggered subscriptions report them again.
+    // Returns false if the socket failed or hung up while waiting
+    bool awaitWritable(int fd);
+
     // Resume thread execution after it called wait()
     // Typically called by a Reactor when I/O events are ready
     // Returns true if thread is still active, false if thread completed
@@ -73,12 +115,27 @@ public:
     // Call wait() to yield control when waiting for I/O
     virtual void run() = 0;
 
+    // Returns true once run() returned
+    bool finished() const noexcept {
+        return (_stack_size > 0) && (_ret.data == nullptr);
+    }
+
+    // Returns the thread running on this OS thread, null outside of coroutines
+    static LightThread* current();
+
     // Initialize and start the thread with specified stack size
     // Allocates stack memory and begins execution of run() method
-    // Must be called before resume() can be used
+    // The stack comes from this thread's `stack_pool` if set, otherwise it is mapped
+    // on the spot. Must be called before resume() can be used
     void start(size_t stack_size);
 
 private:
+    // The reactor links its subscriptions for this thread through the head below
+    friend class Reactor;
+
+    // Synchronization primitives park threads through the wait hook below
+    friend class WaitQueue;
+
     // Static entry point called by Boost.Context when thread starts
     // Sets up the coroutine context and calls the virtual run() method
     static void entry(transfer_t t);
@@ -94,6 +151,30 @@ private:
 
     // Requested stack size (may differ from actual allocated size)
     size_t _stack_size;
+
+    // Pool the stack came from, null if it was mapped by StackAllocator
+    StackPool* _stack_pool;
+
+    // Reactor this thread is currently subscribed to, null if none
+    // A thread can only be subscribed to one reactor at a time
+    Reactor* _reactor;
+
+    // Reactor that last posted or subscribed this thread, null if none.
+    // Threads woken from a wait queue are posted there, see WaitQueue::wake()
+    Reactor* _scheduler;
+
+    // Head of the intrusive chain of subscriptions of this thread in `_reactor`
+    IntrusiveIndexListHead<std::uint32_t> _subscriptions;
+
+    // Number of events and position of this thread in the reactor batch
+    std::uint32_t _batch_count;
+    std::uint32_t _batch_offset;
+
+    // Next thread in the wait queue this thread is parked on
+    LightThread* _wait_next;
+
+    // True while parked on a wait queue
+    bool _wait_queued;
 };
 
 }  // namespace hbthreads
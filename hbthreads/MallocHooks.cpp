@@ -3,11 +3,15 @@
 // This file implements debugging hooks for intercepting and logging memory
 // allocation calls (malloc, free, calloc, realloc). When enabled, it provides
 // detailed tracing of memory operations including allocation sizes, addresses,
-// and caller information.
+// and caller information. In quiet mode the calls are only counted, which
+// lets tests check that a section of code does not allocate. In profile mode
+// the calls are aggregated per call stack in a fixed table that is dumped on
+// demand, so the hooks can stay on under real load. AllocationGuard turns any
+// allocation inside a scope into a failure.
 //
 // The hooks use weak symbol declarations to allow GLIBC to override them
 // during static linking. The caller address is captured using GCC's
-// __builtin_frame_address() for debugging purposes.
+// __builtin_return_address() for debugging purposes.
 
 #include <malloc.h>
 #include <stdio.h>
@@ -15,7 +19,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <execinfo.h>
+#include <atomic>
 #include "BufferPrinter.h"
+#include "MallocHooks.h"
 
 extern "C" void* __libc_malloc(size_t size);     // NOLINT(bugprone-reserved-identifier)
 extern "C" void __libc_free(void*);              // NOLINT(bugprone-reserved-identifier)
@@ -31,65 +38,208 @@ extern "C" void* __libc_realloc(void*, size_t);  // NOLINT(bugprone-reserved-ide
 // Set this to "1" in main to get the printouts
 int malloc_hook_active = 0;
 
+// Counts allocations while active, so tests can assert there were none
+std::atomic<unsigned long> malloc_hook_counter(0);
+
+// Set this to "1" to count without printing
+int malloc_hook_quiet = 0;
+
+// Set this to "1" to aggregate per callsite without printing
+int malloc_hook_profile = 0;
+
+// Calls that found the profile table full
+std::atomic<unsigned long> malloc_profile_dropped(0);
+
+// Number of AllocationGuard objects alive
+static int malloc_hook_forbid = 0;
+
+// Abort on the first allocation under a guard
+static int malloc_hook_abort = 0;
+
+// Allocations under a guard so far
+static std::atomic<unsigned long> malloc_hook_violations(0);
+
+// Set while this thread runs a hook, so the calls the hook makes go to glibc
+static __thread int malloc_hook_busy = 0;
+
+namespace {
+
+// Aggregated calls from one call stack
+struct CallSite {
+    std::atomic<uint64_t> hash;    // stack hash, zero if the slot is free
+    std::atomic<int> ready;        // frames are filled in
+    std::atomic<uint64_t> allocs;  // malloc(), calloc() and realloc() calls
+    std::atomic<uint64_t> frees;   // free() calls
+    std::atomic<uint64_t> bytes;   // bytes requested
+    void* frames[MallocProfileDepth];
+    int depth;
+};
+
+// What a hook intercepted
+enum class Call { Alloc, Free };
+
+// Fixed table, open addressing. Slots are claimed with a CAS and never freed
+// until malloc_profile_reset(), so no locks are needed
+CallSite profile[MallocProfileSize];
+
+// Frames above the callsite we capture to find it
+constexpr int HookFrames = 8;
+
+// Captures the stack from the caller of the intercepted function up
+int captureStack(void* caller, void** frames) {
+    void* stack[MallocProfileDepth + HookFrames];
+    int nf = backtrace(stack, MallocProfileDepth + HookFrames);
+    // Skip the hook frames, however much they got inlined
+    int first = 0;
+    while ((first < nf) && (stack[first] != caller)) {
+        first++;
+    }
+    if (first == nf) first = 0;
+    int depth = 0;
+    for (int j = first; (j < nf) && (depth < MallocProfileDepth); ++j) {
+        frames[depth++] = stack[j];
+    }
+    return depth;
+}
+
+// Adds the call to its callsite
+void profileCall(Call call, size_t size, void* caller) {
+    void* frames[MallocProfileDepth];
+    int depth = captureStack(caller, frames);
+
+    // FNV-1a over the return addresses
+    uint64_t hash = 14695981039346656037ULL;
+    for (int j = 0; j < depth; ++j) {
+        hash = (hash ^ uint64_t(frames[j])) * 1099511628211ULL;
+    }
+    if (hash == 0) hash = 1;
+
+    for (unsigned long probe = 0; probe < MallocProfileSize; ++probe) {
+        CallSite& site(profile[(hash + probe) % MallocProfileSize]);
+        uint64_t key = site.hash.load(std::memory_order_acquire);
+        if (key == 0) {
+            if (site.hash.compare_exchange_strong(key, hash, std::memory_order_acq_rel)) {
+                for (int j = 0; j < depth; ++j) {
+                    site.frames[j] = frames[j];
+                }
+                site.depth = depth;
+                site.ready.store(1, std::memory_order_release);
+                key = hash;
+            }
+        }
+        if (key != hash) continue;
+        if (call == Call::Alloc) {
+            site.allocs.fetch_add(1, std::memory_order_relaxed);
+            site.bytes.fetch_add(size, std::memory_order_relaxed);
+        } else {
+            site.frees.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    malloc_profile_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+// An allocation under a guard
+void violation(size_t size, void* caller) {
+    malloc_hook_violations.fetch_add(1, std::memory_order_relaxed);
+    if (malloc_hook_abort == 0) return;
+    BufferPrinter<64> bf;
+    bf << "Allocation of ";
+    bf.dec(size) << " bytes in a hot section\n";
+    bf.printerr();
+    void* frames[MallocProfileDepth];
+    int depth = captureStack(caller, frames);
+    backtrace_symbols_fd(frames, depth, fileno(stderr));
+    abort();
+}
+
+// Common bookkeeping of every intercepted call
+// Returns true if the call should be printed
+bool intercept(Call call, size_t size, void* caller) {
+    if (call == Call::Alloc) {
+        malloc_hook_counter.fetch_add(1, std::memory_order_relaxed);
+        if (malloc_hook_forbid > 0) violation(size, caller);
+    }
+    if (malloc_hook_profile != 0) {
+        profileCall(call, size, caller);
+        return false;
+    }
+    return (malloc_hook_quiet == 0) && (malloc_hook_forbid == 0);
+}
+
+// Writes the profile to stderr at exit
+void dumpAtExit() {
+    malloc_hook_active = 0;
+    malloc_profile_dump(fileno(stderr));
+}
+
+}  // namespace
+
 // Hook function for malloc calls - logs allocation details and caller
 static void* malloc_hook(size_t size, void* caller) {
     void* result;
-    malloc_hook_active = 0;
+    malloc_hook_busy = 1;
     result = malloc(size);
-    BufferPrinter<64> bf;
-    bf << "malloc(" << size << ")=" << result << " Caller:" << caller << "\n";
-    bf.printerr();
-    malloc_hook_active = 1;
+    if (intercept(Call::Alloc, size, caller)) {
+        BufferPrinter<64> bf;
+        bf << "malloc(" << size << ")=" << result << " Caller:" << caller << "\n";
+        bf.printerr();
+    }
+    malloc_hook_busy = 0;
     return result;
 }
 
 // Hook function for free calls - logs deallocation details and caller
 static void free_hook(void* ptr, void* caller) {
-    malloc_hook_active = 0;
-    BufferPrinter<64> bf;
-    bf << "free(" << ptr << ") caller:" << caller << "\n";
-    bf.printerr();
+    malloc_hook_busy = 1;
+    if (intercept(Call::Free, 0, caller)) {
+        BufferPrinter<64> bf;
+        bf << "free(" << ptr << ") caller:" << caller << "\n";
+        bf.printerr();
+    }
     free(ptr);
-    malloc_hook_active = 1;
+    malloc_hook_busy = 0;
 }
 
 // Hook function for calloc calls - logs allocation details and caller
 static void* calloc_hook(size_t nmemb, size_t size, void* caller) {
-    malloc_hook_active = 0;
+    malloc_hook_busy = 1;
     void* result = calloc(nmemb, size);
-    BufferPrinter<64> bf;
-    bf << "calloc(" << nmemb << "," << size << ") = " << result << "  caller:" << caller
-       << "\n";
-    bf.printerr();
-    malloc_hook_active = 1;
+    if (intercept(Call::Alloc, nmemb * size, caller)) {
+        BufferPrinter<64> bf;
+        bf << "calloc(" << nmemb << "," << size << ") = " << result
+           << "  caller:" << caller << "\n";
+        bf.printerr();
+    }
+    malloc_hook_busy = 0;
     return result;
 }
 
 // Hook function for realloc calls - logs reallocation details and caller
 static void* realloc_hook(void* ptr, size_t size, void* caller) {
-    malloc_hook_active = 0;
+    malloc_hook_busy = 1;
     void* result = realloc(ptr, size);
-    BufferPrinter<64> bf;
-    bf << "realloc(" << ptr << "," << size << ") = " << result << "  caller:" << caller
-       << "\n";
-    bf.printerr();
-    malloc_hook_active = 1;
+    if (intercept(Call::Alloc, size, caller)) {
+        BufferPrinter<64> bf;
+        bf << "realloc(" << ptr << "," << size << ") = " << result
+           << "  caller:" << caller << "\n";
+        bf.printerr();
+    }
+    malloc_hook_busy = 0;
     return result;
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wframe-address"
 extern "C" void* malloc(size_t size) {
-    void* caller = __builtin_frame_address(1);
-    if (malloc_hook_active) {
+    void* caller = __builtin_return_address(0);
+    if ((malloc_hook_active != 0) && (malloc_hook_busy == 0)) {
         return malloc_hook(size, caller);
     }
     return __libc_malloc(size);
 }
 
 extern "C" void free(void* ptr) {
-    void* caller = __builtin_frame_address(1);
-    if (malloc_hook_active) {
+    void* caller = __builtin_return_address(0);
+    if ((malloc_hook_active != 0) && (malloc_hook_busy == 0)) {
         free_hook(ptr, caller);
         return;
     }
@@ -97,18 +247,83 @@ extern "C" void free(void* ptr) {
 }
 
 extern "C" void* calloc(size_t nmemb, size_t size) {
-    void* caller = __builtin_frame_address(1);
-    if (malloc_hook_active) {
+    void* caller = __builtin_return_address(0);
+    if ((malloc_hook_active != 0) && (malloc_hook_busy == 0)) {
         return calloc_hook(nmemb, size, caller);
     }
     return __libc_calloc(nmemb, size);
 }
 
 extern "C" void* realloc(void* ptr, size_t size) {
-    void* caller = __builtin_frame_address(1);
-    if (malloc_hook_active) {
+    void* caller = __builtin_return_address(0);
+    if ((malloc_hook_active != 0) && (malloc_hook_busy == 0)) {
         return realloc_hook(ptr, size, caller);
     }
     return __libc_realloc(ptr, size);
 }
-#pragma GCC diagnostic pop
+
+void malloc_profile_reset() {
+    // The first backtrace() loads the unwinder, which allocates
+    void* frames[1];
+    backtrace(frames, 1);
+    for (CallSite& site : profile) {
+        site.ready.store(0, std::memory_order_relaxed);
+        site.allocs.store(0, std::memory_order_relaxed);
+        site.frees.store(0, std::memory_order_relaxed);
+        site.bytes.store(0, std::memory_order_relaxed);
+        site.hash.store(0, std::memory_order_release);
+    }
+    malloc_profile_dropped.store(0, std::memory_order_relaxed);
+}
+
+void malloc_profile_dump(int fd) {
+    unsigned long count = 0;
+    for (const CallSite& site : profile) {
+        if (site.ready.load(std::memory_order_acquire) != 0) count++;
+    }
+    BufferPrinter<128> bf;
+    bf << "malloc profile: ";
+    bf.dec(count) << " callsites, ";
+    bf.dec(malloc_profile_dropped.load(std::memory_order_relaxed)) << " dropped\n";
+    bf.write(fd);
+    for (const CallSite& site : profile) {
+        if (site.ready.load(std::memory_order_acquire) == 0) continue;
+        BufferPrinter<128> line;
+        line << "allocs ";
+        line.dec(site.allocs.load(std::memory_order_relaxed)) << " frees ";
+        line.dec(site.frees.load(std::memory_order_relaxed)) << " bytes ";
+        line.dec(site.bytes.load(std::memory_order_relaxed)) << " hash ";
+        line << site.hash.load(std::memory_order_relaxed) << "\n";
+        line.write(fd);
+        backtrace_symbols_fd(const_cast<void* const*>(site.frames), site.depth, fd);
+    }
+}
+
+void malloc_profile_dump_at_exit() {
+    static bool registered = false;
+    if (registered) return;
+    registered = true;
+    atexit(dumpAtExit);
+}
+
+AllocationGuard::AllocationGuard(bool abort_on_allocation)
+    : _active(malloc_hook_active),
+      _abort(malloc_hook_abort),
+      _violations(malloc_hook_violations.load(std::memory_order_relaxed)) {
+    // Load the unwinder now so it does not count as a violation
+    void* frames[1];
+    backtrace(frames, 1);
+    malloc_hook_forbid += 1;
+    malloc_hook_abort = abort_on_allocation ? 1 : 0;
+    malloc_hook_active = 1;
+}
+
+AllocationGuard::~AllocationGuard() {
+    malloc_hook_active = _active;
+    malloc_hook_abort = _abort;
+    malloc_hook_forbid -= 1;
+}
+
+unsigned long AllocationGuard::violations() const {
+    return malloc_hook_violations.load(std::memory_order_relaxed) - _violations;
+}
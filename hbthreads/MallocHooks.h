@@ -3,6 +3,67 @@
 // This file is not part of the library but it is a helper for the example
 // to show the allocations that are (not) done
 
+#include <atomic>
+
 //! Defines if the malloc(), realloc(), calloc() and free() calls should be intercepted.
 //! Implemented in MallocHooks.cpp
+//! This is only the switch, the hooks never write it. Calls a hook makes itself
+//! are told apart per thread, so all threads are intercepted all the time.
 extern int malloc_hook_active;
+
+//! Number of malloc(), realloc() and calloc() calls intercepted while the hook
+//! was active. Reset it to zero before the section you want to check.
+extern std::atomic<unsigned long> malloc_hook_counter;
+
+//! Set this to "1" to only count the intercepted calls, without the printouts
+extern int malloc_hook_quiet;
+
+//! Set this to "1" to aggregate the intercepted calls per callsite instead of
+//! printing them, see `malloc_profile_dump()`. Calls from all threads are
+//! counted, the table is updated without locks
+extern int malloc_hook_profile;
+
+//! Number of distinct call stacks the profile can hold. Calls from stacks
+//! beyond that are only counted in `malloc_profile_dropped`
+constexpr unsigned long MallocProfileSize = 1024;
+
+//! Number of return addresses kept per call stack
+constexpr int MallocProfileDepth = 6;
+
+//! Calls that did not fit in the profile table
+extern std::atomic<unsigned long> malloc_profile_dropped;
+
+//! Forgets all callsites. Call it once before profiling, it also loads what
+//! the stack unwinder needs so that does not happen inside a hook
+void malloc_profile_reset();
+
+//! Writes one line per callsite with its counts and bytes followed by its
+//! stack, without allocating
+void malloc_profile_dump(int fd);
+
+//! Writes the profile to stderr when the program exits
+void malloc_profile_dump_at_exit();
+
+//! Makes any allocation in the scope a failure, to prove a hot section does
+//! not allocate. By default it prints the offending stack and aborts, otherwise
+//! it counts the allocations in `violations()`.
+//! Guards can nest. Only the thread that owns the hooks should use them.
+class AllocationGuard {
+public:
+    //! Starts intercepting allocations
+    explicit AllocationGuard(bool abort_on_allocation = true);
+
+    //! Restores the hooks as they were
+    ~AllocationGuard();
+
+    AllocationGuard(const AllocationGuard&) = delete;
+    AllocationGuard& operator=(const AllocationGuard&) = delete;
+
+    //! Number of allocations in the scope so far
+    unsigned long violations() const;
+
+private:
+    int _active;                  //! hook state before us
+    int _abort;                   //! abort state before us
+    unsigned long _violations;    //! violations before us
+};
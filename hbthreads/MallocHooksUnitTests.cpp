@@ -0,0 +1,281 @@
+#include <gtest/gtest.h>
+#include "EpollReactor.h"
+#include "LightThread.h"
+#include "MallocHooks.h"
+#include <boost/container/pmr/global_resource.hpp>
+#include <sys/eventfd.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace hbthreads;
+
+namespace {
+
+// Consumes the eventfd counter and finishes after a number of events
+class ReaderThread : public LightThread {
+public:
+    ReaderThread(int max_events) : max_events(max_events) {
+    }
+    int max_events;
+    int events_received = 0;
+
+    void run() override {
+        while (events_received < max_events) {
+            for (const Event& ev : *wait()) {
+                eventfd_t value;
+                eventfd_read(ev.fd, &value);
+                events_received++;
+            }
+        }
+    }
+};
+
+// One callsite, so all its calls land in the same profile entry
+__attribute__((noinline)) void allocateAndFree(size_t size) {
+    void* volatile ptr = malloc(size);
+    free(ptr);
+}
+
+// Reads back what was written to the file
+std::string readAll(FILE* file) {
+    std::string text;
+    rewind(file);
+    char buf[4096];
+    size_t nb;
+    while ((nb = fread(buf, 1, sizeof(buf), file)) > 0) {
+        text.append(buf, nb);
+    }
+    return text;
+}
+
+}  // namespace
+
+class MallocHooksTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+    }
+
+    void TearDown() override {
+        malloc_hook_active = 0;
+        malloc_hook_quiet = 0;
+        malloc_hook_profile = 0;
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    // Starts counting allocations without printing them
+    // The compiler assumes malloc() does not touch our globals so we need
+    // barriers to keep it from moving these around the calls
+    void startCounting() {
+        malloc_hook_quiet = 1;
+        malloc_hook_counter = 0;
+        malloc_hook_active = 1;
+        asm volatile("" ::: "memory");
+    }
+
+    // Stops counting and returns the number of allocations
+    unsigned long stopCounting() {
+        asm volatile("" ::: "memory");
+        malloc_hook_active = 0;
+        return malloc_hook_counter;
+    }
+
+    // Reactors in these tests allocate straight from new/delete so that any
+    // use of their memory resource shows up as a malloc() call
+    MemoryStorage* heap = boost::container::pmr::new_delete_resource();
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+};
+
+TEST_F(MallocHooksTest, CountsAllocations) {
+    startCounting();
+    // volatile so the compiler does not elide the pair
+    void* volatile ptr = malloc(64);
+    free(ptr);
+    EXPECT_EQ(stopCounting(), 1UL);
+}
+
+TEST_F(MallocHooksTest, SteadyStateWorkDoesNotAllocate) {
+    const int NUM_FDS = 4;
+    const int NUM_LOOPS = 1000;
+    EpollReactor reactor(heap, DateTime::msecs(10));
+    Pointer<ReaderThread> thread(new ReaderThread(NUM_FDS * NUM_LOOPS));
+    thread->start(16 * 1024);
+
+    int fds[NUM_FDS];
+    for (int& fd : fds) {
+        fd = eventfd(0, EFD_NONBLOCK);
+        ASSERT_GE(fd, 0);
+        reactor.monitor(fd, thread.get());
+    }
+
+    startCounting();
+    for (int j = 0; j < NUM_LOOPS; ++j) {
+        for (int fd : fds) {
+            eventfd_write(fd, 1);
+        }
+        reactor.work();
+    }
+    unsigned long allocations = stopCounting();
+
+    EXPECT_EQ(allocations, 0UL);
+    EXPECT_EQ(thread->events_received, NUM_FDS * NUM_LOOPS);
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+TEST_F(MallocHooksTest, BatchedWorkDoesNotAllocate) {
+    const int NUM_FDS = 16;
+    const int NUM_LOOPS = 1000;
+    EpollReactor reactor(heap, DateTime::msecs(10));
+    reactor.setBatching(true);
+    Pointer<ReaderThread> thread(new ReaderThread(NUM_FDS * NUM_LOOPS));
+    thread->start(16 * 1024);
+
+    int fds[NUM_FDS];
+    for (int& fd : fds) {
+        fd = eventfd(0, EFD_NONBLOCK);
+        ASSERT_GE(fd, 0);
+        reactor.monitor(fd, thread.get());
+    }
+
+    startCounting();
+    for (int j = 0; j < NUM_LOOPS; ++j) {
+        for (int fd : fds) {
+            eventfd_write(fd, 1);
+        }
+        reactor.work();
+    }
+    unsigned long allocations = stopCounting();
+
+    EXPECT_EQ(allocations, 0UL);
+    EXPECT_EQ(thread->events_received, NUM_FDS * NUM_LOOPS);
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+TEST_F(MallocHooksTest, CompletedThreadCleanupDoesNotAllocate) {
+    const int NUM_THREADS = 8;
+    EpollReactor reactor(heap, DateTime::msecs(10));
+
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    Pointer<ReaderThread> threads[NUM_THREADS];
+    for (Pointer<ReaderThread>& thread : threads) {
+        thread.reset(new ReaderThread(1));
+        thread->start(16 * 1024);
+        reactor.monitor(fd, thread.get());
+    }
+
+    // All threads finish on the same event and are removed in the same dispatch
+    startCounting();
+    eventfd_write(fd, 1);
+    reactor.work();
+    unsigned long allocations = stopCounting();
+
+    EXPECT_EQ(allocations, 0UL);
+    EXPECT_FALSE(reactor.active());
+    close(fd);
+}
+
+TEST_F(MallocHooksTest, ProfileAggregatesCallsites) {
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    malloc_profile_reset();
+    malloc_hook_profile = 1;
+    malloc_hook_active = 1;
+    asm volatile("" ::: "memory");
+    for (int j = 0; j < 10; ++j) {
+        allocateAndFree(100);
+    }
+    asm volatile("" ::: "memory");
+    malloc_hook_active = 0;
+    malloc_profile_dump(fileno(file));
+
+    std::string text = readAll(file);
+    fclose(file);
+    EXPECT_NE(text.find("malloc profile: 2 callsites, 0 dropped\n"), std::string::npos)
+        << text;
+    EXPECT_NE(text.find("allocs 10 frees 0 bytes 1000 hash"), std::string::npos) << text;
+    EXPECT_NE(text.find("allocs 0 frees 10 bytes 0 hash"), std::string::npos) << text;
+}
+
+TEST_F(MallocHooksTest, ProfileCountsAllThreads) {
+    const int NUM_THREADS = 4;
+    const int NUM_CALLS = 10000;
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    malloc_profile_reset();
+    malloc_hook_profile = 1;
+    malloc_hook_active = 1;
+    asm volatile("" ::: "memory");
+    std::thread threads[NUM_THREADS];
+    for (std::thread& thread : threads) {
+        thread = std::thread([]() {
+            for (int j = 0; j < NUM_CALLS; ++j) {
+                allocateAndFree(100);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    asm volatile("" ::: "memory");
+    malloc_hook_active = 0;
+    malloc_profile_dump(fileno(file));
+
+    // No call is lost while other threads are inside a hook
+    std::string text = readAll(file);
+    fclose(file);
+    EXPECT_NE(text.find("allocs 40000 frees 0 bytes 4000000 hash"), std::string::npos)
+        << text;
+    EXPECT_NE(text.find("allocs 0 frees 40000 bytes 0 hash"), std::string::npos) << text;
+}
+
+TEST_F(MallocHooksTest, GuardCountsAllocations) {
+    const int NUM_FDS = 4;
+    EpollReactor reactor(heap, DateTime::msecs(10));
+    Pointer<ReaderThread> thread(new ReaderThread(NUM_FDS * 100));
+    thread->start(16 * 1024);
+    int fds[NUM_FDS];
+    for (int& fd : fds) {
+        fd = eventfd(0, EFD_NONBLOCK);
+        ASSERT_GE(fd, 0);
+        reactor.monitor(fd, thread.get());
+    }
+    {
+        AllocationGuard guard(false);
+        for (int j = 0; j < 100; ++j) {
+            for (int fd : fds) {
+                eventfd_write(fd, 1);
+            }
+            reactor.work();
+        }
+        EXPECT_EQ(guard.violations(), 0UL);
+        allocateAndFree(16);
+        EXPECT_EQ(guard.violations(), 1UL);
+    }
+    EXPECT_EQ(malloc_hook_active, 0);
+    EXPECT_EQ(thread->events_received, NUM_FDS * 100);
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+TEST_F(MallocHooksTest, GuardAbortsOnAllocation) {
+    EXPECT_DEATH(
+        {
+            AllocationGuard guard;
+            allocateAndFree(16);
+        },
+        "Allocation of 16 bytes in a hot section");
+}
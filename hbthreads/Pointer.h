@@ -2,40 +2,39 @@
 //
 // This header provides an intrusive smart pointer system designed for high-performance
 // applications. The Pointer<T> class wraps boost::intrusive_ptr and provides automatic
-// reference counting for objects inheriting from ObjectCounter.
+// reference counting for objects inheriting from Object or FinalObject.
 //
 // Key features:
 // - Zero-overhead reference counting using intrusive counters
-// - Custom memory allocation with size embedding for efficient deallocation
+// - Custom memory allocation with sized deallocation, nothing stored per object
 // - Thread-local memory pool support for allocation performance
 // - Hash map/set support through std::hash specialization
-// - Configurable counter and size types for memory optimization
+// - Configurable counter type for memory optimization
+// - Plain or atomic reference counting per class, see LocalCount and SharedCount
 
 #pragma once
 #include "ImportedTypes.h"
+#include <atomic>
+#include <type_traits>
 
 namespace hbthreads {
 
-// Configuration macros for optimizing memory usage in small objects
-// These can be enabled via CMake: -DUSE_SMALL_COUNTER=ON -DUSE_SMALL_SIZE=ON
+// Configuration macro for optimizing memory usage in small objects
+// This can be enabled via CMake: -DUSE_SMALL_COUNTER=ON
 #ifdef USE_SMALL_COUNTER
 #define IntrusiveCounterType std::uint16_t
 #else
 #define IntrusiveCounterType std::uint32_t
 #endif
 
-#ifdef USE_SMALL_SIZE
-#define IntrusiveSizeType std::uint16_t
-#else
-#define IntrusiveSizeType std::uint32_t
-#endif
-
 // Thread-local memory storage for custom allocation
-// Must be initialized before allocating any ObjectCounter subclasses
+// Must be initialized before allocating any Object or FinalObject subclasses
+// Objects are freed into the storage of the thread releasing them, so objects
+// crossing threads need a storage that accepts foreign blocks, see RemoteFreePool
 extern __thread MemoryStorage* storage;
 
 // Intrusive smart pointer template providing automatic reference counting
-// and hash container support. Objects must inherit from ObjectCounter.
+// and hash container support. Objects must inherit from Object or FinalObject.
 template <typename T>
 class Pointer : public IntrusivePointer<T> {
 public:
@@ -44,7 +43,7 @@ public:
     }
 
     // Constructor taking ownership of a raw pointer
-    // The pointed-to object must inherit from ObjectCounter
+    // The pointed-to object must inherit from Object or FinalObject
     Pointer(T* ptr) : IntrusivePointer<T>(ptr) {
     }
 
@@ -55,23 +54,51 @@ public:
     }
 };
 
-// Base class providing intrusive reference counting functionality
-// All objects managed by Pointer<T> must inherit from this class.
-// Uses custom operator new/delete with size embedding for efficient deallocation.
-class ObjectCounter {
-protected:
-    // Protected constructor prevents direct instantiation
-    // Initializes reference counter to 0
-    ObjectCounter() : _counter(0) {
+// Reference counting policies, picked at compile time per class hierarchy.
+// LocalCount is a plain counter for objects that never leave their thread.
+// SharedCount is atomic for objects referenced from several threads at once,
+// like reference data shared across cores. Only those pay for the atomics.
+struct LocalCount {
+    using Counter = IntrusiveCounterType;
+
+    static void increment(Counter& counter) noexcept {
+        counter += 1;
     }
 
-public:
-    // Virtual destructor for polymorphic deletion
-    virtual ~ObjectCounter() noexcept {
+    // Returns true if this was the last reference
+    static bool decrement(Counter& counter) noexcept {
+        if (counter > 1) {
+            counter -= 1;
+            return false;
+        }
+        return true;
+    }
+};
+
+struct SharedCount {
+    using Counter = std::atomic<IntrusiveCounterType>;
+
+    // Taking a reference needs no ordering, we already hold one
+    static void increment(Counter& counter) noexcept {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Releases publish our writes to the thread that deletes the object, which
+    // acquires them before running the destructor
+    static bool decrement(Counter& counter) noexcept {
+        if (counter.fetch_sub(1, std::memory_order_release) != 1) return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
     }
+};
 
+// Custom allocation shared by all counting policies
+// Objects are allocated from the thread-local storage at their natural size.
+// The compiler passes the size back on delete - the dynamic type size when
+// the destructor is virtual - so nothing is stored next to the object.
+class ObjectStorage {
+public:
     // Custom operator new using thread-local memory storage
-    // Embeds allocation size before the returned pointer for deallocation
     void* operator new(size_t size) {
         // CRITICAL: Ensure storage is initialized before allocating objects
         assert(storage != nullptr &&
@@ -79,65 +106,146 @@ public:
                "subclasses");
 
         // This will catch bad things in debug mode
-        assert(size < std::numeric_limits<IntrusiveSizeType>::max());
         assert(_library_counter_size == sizeof(IntrusiveCounterType));
-        assert(_library_chunk_size == sizeof(IntrusiveSizeType));
 
-        // Allocates oversized space
-        uint8_t* ptr = (uint8_t*)storage->allocate(size + sizeof(IntrusiveSizeType));
-        // Embed the counter
-        *((IntrusiveSizeType*)ptr) = size;
-        // Returns pointer to after the counter
-        return ptr + sizeof(IntrusiveSizeType);
+        return storage->allocate(size);
     }
 
-    // Custom operator delete for deallocation
-    // Retrieves embedded size and calls storage deallocator
-    void operator delete(void* p) noexcept {
-        // Gets pointer to the original space
-        uint8_t* ptr = ((uint8_t*)p) - sizeof(IntrusiveSizeType);
-        // Retrieves the size
-        size_t size = *((IntrusiveSizeType*)ptr);
-        // Calls the memory storage deallocator with the pointer and size
-        storage->deallocate(ptr, size);
+    // Custom sized operator delete, returns the block to the storage
+    void operator delete(void* p, size_t size) noexcept {
+        storage->deallocate(p, size);
+    }
+
+private:
+    // Static sanity check variable
+    static std::uint32_t _library_counter_size;
+};
+
+// Base class providing intrusive reference counting functionality
+// Objects managed by Pointer<T> inherit from this class or from FinalObject.
+// Uses custom operator new/delete with sized deallocation.
+// The policy decides how the counter is updated, see LocalCount and SharedCount.
+template <typename Policy>
+class BasicObjectCounter : public ObjectStorage {
+protected:
+    // Protected constructor prevents direct instantiation
+    // Initializes reference counter to 0
+    BasicObjectCounter() : _counter(0) {
+    }
+
+    // Copies are new objects, nobody references them yet
+    BasicObjectCounter(const BasicObjectCounter&) : _counter(0) {
+    }
+
+    // Assigning does not change who references us
+    BasicObjectCounter& operator=(const BasicObjectCounter&) {
+        return *this;
+    }
+
+public:
+    // Virtual destructor for polymorphic deletion
+    virtual ~BasicObjectCounter() noexcept {
     }
 
 private:
     // Friend functions for boost::intrusive_ptr reference counting
-    friend void intrusive_ptr_add_ref(ObjectCounter*);
+    template <typename P>
+    friend void intrusive_ptr_add_ref(BasicObjectCounter<P>*) noexcept;
 
     // Friend functions for boost::intrusive_ptr reference counting
-    friend void intrusive_ptr_release(ObjectCounter*);
+    template <typename P>
+    friend void intrusive_ptr_release(BasicObjectCounter<P>*) noexcept;
 
     // Reference counter for intrusive pointer management
-    IntrusiveCounterType _counter;
-
-    // Static sanity check variables
-    static std::uint32_t _library_counter_size;
-    static std::uint32_t _library_chunk_size;
+    typename Policy::Counter _counter;
 };
 
 // Boost intrusive_ptr support function - increments reference count
-inline void intrusive_ptr_add_ref(ObjectCounter* p) noexcept {
-    p->_counter += 1;
+template <typename Policy>
+inline void intrusive_ptr_add_ref(BasicObjectCounter<Policy>* p) noexcept {
+    Policy::increment(p->_counter);
 }
 
 // Boost intrusive_ptr support function - decrements reference count and deletes when 0
-inline void intrusive_ptr_release(ObjectCounter* p) noexcept {
-    if (p->_counter > 1) {
-        p->_counter -= 1;
-        return;
+template <typename Policy>
+inline void intrusive_ptr_release(BasicObjectCounter<Policy>* p) noexcept {
+    if (Policy::decrement(p->_counter)) {
+        delete p;
     }
-    delete p;
 }
 
+// The single threaded counter, what all library classes use
+using ObjectCounter = BasicObjectCounter<LocalCount>;
+
 // Concrete base class for objects managed by intrusive pointers
-// Uses virtual inheritance to prevent diamond problem in multiple inheritance scenarios
-class Object : public virtual ObjectCounter {
-    // Inherit constructors from ObjectCounter
-    using ObjectCounter::ObjectCounter;
+// A class must not inherit it more than once, its counter would be duplicated
+template <typename Policy>
+class BasicObject : public BasicObjectCounter<Policy> {
+    // Inherit constructors from the counter
+    using BasicObjectCounter<Policy>::BasicObjectCounter;
 };
 
+// Objects owned by a single thread at a time
+class Object : public BasicObject<LocalCount> {
+    using BasicObject<LocalCount>::BasicObject;
+};
+
+// Objects referenced from several threads at once. Their memory storage must
+// accept frees from any of them, see RemoteFreePool
+using SharedObject = BasicObject<SharedCount>;
+
+// Base class for objects without a vtable, like the millions of small records
+// an application keeps around. `Derived` is the class inheriting from it and
+// must be final: the object is deleted as a `Derived`, without virtual calls.
+// Such objects are as large as their members plus the counter.
+template <typename Derived, typename Policy = LocalCount>
+class FinalObject : public ObjectStorage {
+protected:
+    // Protected constructor prevents direct instantiation
+    FinalObject() : _counter(0) {
+    }
+
+    // Copies are new objects, nobody references them yet
+    FinalObject(const FinalObject&) : _counter(0) {
+    }
+
+    // Assigning does not change who references us
+    FinalObject& operator=(const FinalObject&) {
+        return *this;
+    }
+
+    // Not virtual, only Derived gets deleted
+    ~FinalObject() noexcept {
+    }
+
+private:
+    // Friend functions for boost::intrusive_ptr reference counting
+    template <typename D, typename P>
+    friend void intrusive_ptr_add_ref(FinalObject<D, P>*) noexcept;
+
+    // Friend functions for boost::intrusive_ptr reference counting
+    template <typename D, typename P>
+    friend void intrusive_ptr_release(FinalObject<D, P>*) noexcept;
+
+    // Reference counter for intrusive pointer management
+    typename Policy::Counter _counter;
+};
+
+// Boost intrusive_ptr support function - increments reference count
+template <typename Derived, typename Policy>
+inline void intrusive_ptr_add_ref(FinalObject<Derived, Policy>* p) noexcept {
+    Policy::increment(p->_counter);
+}
+
+// Boost intrusive_ptr support function - decrements reference count and deletes when 0
+template <typename Derived, typename Policy>
+inline void intrusive_ptr_release(FinalObject<Derived, Policy>* p) noexcept {
+    static_assert(std::is_final<Derived>::value, "FinalObject subclasses must be final");
+    if (Policy::decrement(p->_counter)) {
+        delete static_cast<Derived*>(p);
+    }
+}
+
 }  // namespace hbthreads
 
 namespace std {
@@ -12,6 +12,9 @@
 
 #include <gtest/gtest.h>
 #include "Pointer.h"
+#include <boost/container/pmr/global_resource.hpp>
+#include <thread>
+#include <vector>
 
 using namespace hbthreads;
 
@@ -206,4 +209,141 @@ TEST_F(PointerTest, HashSupport) {
     std::hash<Pointer<TestObject>> hasher;
     EXPECT_EQ(hasher(ptr1), hasher(ptr2));  // Same object, same hash
     EXPECT_NE(hasher(ptr1), hasher(ptr3));  // Different objects, different hashes
-}
\ No newline at end of file
+}
+
+// Records the sizes objects are freed with
+class SizeRecorder : public boost::container::pmr::memory_resource {
+public:
+    std::size_t allocated = 0;
+    std::size_t deallocated = 0;
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        allocated = bytes;
+        return boost::container::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override {
+        deallocated = bytes;
+        boost::container::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+    bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Subclass larger than the type it is referenced through
+class LargerObject : public TestObject {
+public:
+    LargerObject() : TestObject(7) {
+    }
+    char payload[100];
+};
+
+// A record without a vtable
+class Record final : public FinalObject<Record> {
+public:
+    static int destructor_count;
+
+    ~Record() {
+        destructor_count++;
+    }
+    std::uint32_t quantity;
+    std::uint64_t price;
+};
+
+int Record::destructor_count = 0;
+
+// Objects are allocated at their size and freed with the size of their dynamic type
+TEST_F(PointerTest, SizedDelete) {
+    SizeRecorder recorder;
+    storage = &recorder;
+    {
+        Pointer<TestObject> object(new LargerObject);
+        EXPECT_EQ(recorder.allocated, sizeof(LargerObject));
+    }
+    EXPECT_EQ(recorder.deallocated, sizeof(LargerObject));
+    EXPECT_EQ(TestObject::destructor_count, 1);
+}
+
+// Final objects are just their counter and members
+TEST_F(PointerTest, FinalObject) {
+    static_assert(sizeof(Record) == 16, "Record should have no overhead");
+    SizeRecorder recorder;
+    storage = &recorder;
+    Record::destructor_count = 0;
+    {
+        Pointer<Record> record(new Record);
+        EXPECT_EQ(recorder.allocated, sizeof(Record));
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(record.get()) % alignof(Record), 0u);
+        Pointer<Record> copy = record;
+        record.reset();
+        EXPECT_EQ(Record::destructor_count, 0);
+    }
+    EXPECT_EQ(Record::destructor_count, 1);
+    EXPECT_EQ(recorder.deallocated, sizeof(Record));
+}
+
+// Test object shared between threads, counted atomically
+class SharedTestObject : public SharedObject {
+public:
+    static std::atomic<int> destructor_count;
+
+    ~SharedTestObject() override {
+        destructor_count++;
+    }
+};
+
+std::atomic<int> SharedTestObject::destructor_count(0);
+
+// Copies of an object start with no references of their own
+TEST_F(PointerTest, CopyDoesNotShareCounter) {
+    Pointer<TestObject> ptr1(new TestObject(42));
+    Pointer<TestObject> ptr2(new TestObject(*ptr1));
+    ptr1.reset();
+    EXPECT_EQ(TestObject::destructor_count, 1);
+    EXPECT_EQ(ptr2->value, 42);
+    ptr2.reset();
+    EXPECT_EQ(TestObject::destructor_count, 2);
+}
+
+// Threads taking and dropping references concurrently never lose a count
+TEST(SharedPointerTest, ConcurrentReferences) {
+    // Every thread frees into the same thread safe resource
+    storage = boost::container::pmr::new_delete_resource();
+    SharedTestObject::destructor_count = 0;
+    {
+        Pointer<SharedTestObject> object(new SharedTestObject);
+        std::vector<std::thread> threads;
+        for (int j = 0; j < 4; ++j) {
+            threads.emplace_back([object]() {
+                storage = boost::container::pmr::new_delete_resource();
+                for (int k = 0; k < 100000; ++k) {
+                    Pointer<SharedTestObject> copy(object);
+                    (void)copy;
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(SharedTestObject::destructor_count, 0);
+    }
+    EXPECT_EQ(SharedTestObject::destructor_count, 1);
+    storage = nullptr;
+}
+
+// The last reference can be dropped by any thread
+TEST(SharedPointerTest, LastReleaseOnOtherThread) {
+    storage = boost::container::pmr::new_delete_resource();
+    SharedTestObject::destructor_count = 0;
+    Pointer<SharedTestObject> object(new SharedTestObject);
+    std::thread thread([&object]() {
+        storage = boost::container::pmr::new_delete_resource();
+        Pointer<SharedTestObject> last;
+        last.swap(object);
+    });
+    thread.join();
+    EXPECT_EQ(object.get(), nullptr);
+    EXPECT_EQ(SharedTestObject::destructor_count, 1);
+    storage = nullptr;
+}
@@ -13,18 +13,33 @@ void PollReactor::work() {
     // Delayed rebuild: Only rebuild when dirty flag is set.
     // This allows batching multiple monitor()/removeSocket() calls.
     if (_dirty) rebuild();
-    if (_fds.empty()) return;
-    int nd = ::poll(_fds.data(), _fds.size(), _timeout.msecs());
+    // Without sockets we still sleep until the next timer
+    if (_fds.empty() && _timers.empty()) {
+        runQueued();
+        return;
+    }
+    // Just peek at the sockets if threads are waiting to run
+    int timeout_ms = runnable() ? 0 : pollTimeout(_timeout).msecs();
+    int nd = ::poll(_fds.data(), _fds.size(), timeout_ms);
     if (nd > 0) {
         for (pollfd& pfd : _fds) {
             if ((pfd.revents & POLLIN) != 0) {
-                notifyEvent(pfd.fd, EventType::SocketRead);
+                deliverEvent(pfd.fd, EventType::SocketRead);
+            }
+            if ((pfd.revents & POLLOUT) != 0) {
+                deliverEvent(pfd.fd, EventType::SocketWriteable);
             }
-            if ((pfd.revents & (POLLNVAL | POLLERR)) != 0) {
-                notifyEvent(pfd.fd, EventType::SocketError);
+            if ((pfd.revents & POLLNVAL) != 0) {
+                deliverEvent(pfd.fd, EventType::SocketError);
+            } else if ((pfd.revents & POLLERR) != 0) {
+                deliverEvent(pfd.fd, errorEvent(pfd.fd));
             }
         }
+        flushEvents();
     }
+
+    // Posted threads and expired timers
+    runQueued();
 }
 
 void PollReactor::onSocketOps(int fd, Operation ops) {
@@ -32,7 +47,7 @@ void PollReactor::onSocketOps(int fd, Operation ops) {
     switch (ops) {
         case Operation::Added: _sockets.insert(fd); break;
         case Operation::Removed: _sockets.erase(fd); break;
-        // We do not handle these yet - TODO
+        // The flags are read again on rebuild
         case Operation::Modified:
         case Operation::NA: break;
     }
@@ -45,6 +60,9 @@ void PollReactor::rebuild() {
         pollfd& pfd(_fds[index]);
         pfd.fd = fd;
         pfd.events = POLLIN;
+        if (hasFlags(socketFlags(fd), MonitorFlags::Writable)) {
+            pfd.events |= POLLOUT;
+        }
         index++;
     }
     _dirty = false;
@@ -2,6 +2,7 @@
 #include "PollReactor.h"
 #include "LightThread.h"
 #include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 using namespace hbthreads;
@@ -22,6 +23,35 @@ public:
     }
 };
 
+namespace {
+
+// Fills its socket and then waits for room to write
+class WriterThread : public LightThread {
+public:
+    WriterThread(int fd) : fd(fd) {
+    }
+    int fd;
+    bool blocked = false;
+    bool writable = false;
+
+    void run() override {
+        char buf[4096] = {};
+        while (::write(fd, buf, sizeof(buf)) > 0) {
+        }
+        blocked = true;
+        writable = awaitWritable(fd);
+    }
+};
+
+// Reads everything pending on a non-blocking socket
+void drainSocket(int fd) {
+    char buf[4096];
+    while (::read(fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+}  // namespace
+
 class PollReactorTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -297,3 +327,45 @@ TEST_F(PollReactorTest, RebuildAfterRemove) {
     close(fd2);
     close(fd3);
 }
+
+TEST_F(PollReactorTest, NoWritableEventsUnlessAsked) {
+    PollReactor reactor(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    reactor.monitor(fds[0], thread.get());
+
+    // The socket has room to write all along but nobody asked
+    reactor.work();
+    EXPECT_EQ(thread->events_received, 0);
+
+    reactor.removeSocket(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(PollReactorTest, AwaitWritable) {
+    PollReactor reactor(buffer, DateTime::msecs(1));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+    Pointer<WriterThread> thread(new WriterThread(fds[0]));
+    reactor.monitor(fds[0], thread.get());
+    thread->start(16 * 1024);
+    ASSERT_TRUE(thread->blocked);
+
+    // Still full
+    reactor.work();
+    EXPECT_FALSE(thread->writable);
+
+    // Make room, the writer gets its event and finishes
+    drainSocket(fds[1]);
+    reactor.work();
+    EXPECT_TRUE(thread->writable);
+    EXPECT_FALSE(reactor.active());
+
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -1,40 +1,259 @@
 #include "Reactor.h"
+#include <sys/socket.h>
+#include <stdio.h>
 
 using namespace hbthreads;
 
 // We have to pass the memory storage to all the container to use,
 // which is a pain but the price to pay for awesomeness
-// Notice that the boost::container::flat* containers do not accept a memory
+// Notice that the boost::container containers do not accept a memory
 // Resource but an allocator so it is implicitly declared
-Reactor::Reactor(MemoryStorage* mem) : _mem(mem), _socket_subs(mem), _thread_subs(mem) {
+Reactor::Reactor(MemoryStorage* mem)
+    : _mem(mem),
+      _subs(mem),
+      _sockets(mem),
+      _num_subs(0),
+      _dispatching(0),
+      _completed(mem),
+      _batching(false),
+      _pending(mem),
+      _batch_threads(mem),
+      _batch_events(mem),
+      _run_queues{Vector<RunEntry>(mem), Vector<RunEntry>(mem), Vector<RunEntry>(mem)},
+      _running(mem),
+      _timers(mem) {
     assert(mem != nullptr && "MemoryStorage must not be null");
+    _completed.reserve(CompletedCapacity);
+    _pending.reserve(BatchCapacity);
+    _batch_threads.reserve(BatchCapacity);
+    _batch_events.reserve(BatchCapacity);
+    for (Vector<RunEntry>& queue : _run_queues) {
+        queue.reserve(RunCapacity);
+    }
+    _running.reserve(RunCapacity);
 }
 
-// All resources removed automagically
+// Threads can outlive the reactor so we detach them from our chains.
+// The subscription vector then releases the threads automagically
 Reactor::~Reactor() {
+    for (Subscription& sub : _subs) {
+        if (sub.thread) {
+            sub.thread->_subscriptions = SubscriptionHead();
+            sub.thread->_reactor = nullptr;
+            if (sub.thread->_scheduler == this) sub.thread->_scheduler = nullptr;
+        }
+    }
+    for (Vector<RunEntry>& queue : _run_queues) {
+        for (RunEntry& entry : queue) {
+            if (entry.thread->_scheduler == this) entry.thread->_scheduler = nullptr;
+        }
+    }
 }
 
 bool Reactor::active() const noexcept {
     // no thread subscriptions, not active
     // this is typically used to terminate loops
-    return !_socket_subs.empty();
+    return (_num_subs > 0) || runnable() || !_timers.empty();
+}
+
+bool Reactor::runnable() const noexcept {
+    for (const Vector<RunEntry>& queue : _run_queues) {
+        if (!queue.empty()) return true;
+    }
+    return false;
+}
+
+void Reactor::post(LightThread* thread, const Event& event, RunPriority priority) {
+    assert(std::size_t(priority) < NumPriorities && "Invalid priority");
+    thread->_scheduler = this;
+    _run_queues[std::size_t(priority)].push_back(RunEntry{thread, event});
+}
+
+Event* Reactor::yield(RunPriority priority) {
+    LightThread* self = LightThread::current();
+    assert(self != nullptr && "Only light threads can yield");
+    Event event;
+    event.type = EventType::Wakeup;
+    event.fd = -1;
+    post(self, event, priority);
+    return self->wait();
+}
+
+Reactor::TimerId Reactor::addTimer(LightThread* thread, DateTime deadline) {
+    return _timers.add(thread, deadline);
+}
+
+bool Reactor::cancelTimer(TimerId id) {
+    return _timers.cancel(id);
+}
+
+void Reactor::sleepUntil(DateTime deadline) {
+    LightThread* self = LightThread::current();
+    assert(self != nullptr && "Only light threads can sleep");
+    TimerId timer = addTimer(self, deadline);
+    while (true) {
+        // Look into all events in case the reactor batches them
+        for (const Event& ev : *self->wait()) {
+            if ((ev.type == EventType::Timeout) && (ev.timer == timer)) return;
+        }
+    }
+}
+
+void Reactor::sleepFor(DateTime interval) {
+    sleepUntil(DateTime::now(DateTime::ClockType::Monotonic) + interval);
+}
+
+DateTime Reactor::pollTimeout(DateTime timeout) const {
+    if (_timers.empty()) return timeout;
+    DateTime now = DateTime::now(DateTime::ClockType::Monotonic);
+    DateTime delay = _timers.nextDeadline() - now;
+    std::int64_t msecs = (delay.nsecs() + 999999) / 1000000;
+    delay = DateTime::msecs(msecs > 0 ? msecs : 0);
+    if ((timeout.nsecs() < 0) || (delay < timeout)) return delay;
+    return timeout;
 }
 
-void Reactor::monitor(int fd, LightThread* thread) {
+void Reactor::runQueued() {
+    // Expired timers go first in the queue
+    if (!_timers.empty()) {
+        _timers.advance(DateTime::now(DateTime::ClockType::Monotonic),
+                        [this](LightThread* thread, TimerId timer) {
+                            Event event;
+                            event.type = EventType::Timeout;
+                            event.timer = timer;
+                            post(thread, event, RunPriority::High);
+                        });
+    }
+    for (Vector<RunEntry>& queue : _run_queues) {
+        if (queue.empty()) continue;
+        // Posts go to the emptied queue while we go through this one
+        _running.swap(queue);
+        for (RunEntry& entry : _running) {
+            LightThread* thread = entry.thread.get();
+            // The thread might have been posted more than once
+            if (thread->finished()) continue;
+            entry.event.count = 1;
+            if (!thread->resume(&entry.event) && (thread->_reactor != nullptr)) {
+                thread->_reactor->removeThread(thread);
+            }
+        }
+        _running.clear();
+    }
+}
+
+Reactor::SubscriptionIndex Reactor::allocate(int fd, LightThread* thread) {
+    // Reuse a slot if we have one, otherwise grow the table
+    ThreadList freelist(_free, _subs);
+    SubscriptionIndex index = freelist.pop_front();
+    if (index == NullIndex) {
+        index = _subs.size();
+        _subs.push_back(Subscription{});
+    }
+    Subscription& sub(_subs[index]);
+    sub.fd = fd;
+    sub.thread = thread;
+    _num_subs += 1;
+    return index;
+}
+
+void Reactor::release(SubscriptionIndex index) {
+    // Take the thread out first as releasing it might call us back
+    Pointer<LightThread> thread;
+    Subscription& sub(_subs[index]);
+    thread.swap(sub.thread);
+    sub.fd = -1;
+    _num_subs -= 1;
+
+    // While dispatching, a loop might be sitting on this slot and will need
+    // its `by_socket` link intact so we cannot reuse it just yet
+    ThreadList freelist(_dispatching > 0 ? _retired : _free, _subs);
+    freelist.push_back(index);
+}
+
+void Reactor::monitor(int fd, LightThread* thread, MonitorFlags flags,
+                      std::uint64_t tag) {
     assert(fd >= 0 && "File descriptor must be valid");
     assert(thread != nullptr && "Thread must not be null");
+    assert(((thread->_reactor == nullptr) || (thread->_reactor == this)) &&
+           "Thread is already subscribed to another reactor");
+    if ((thread->_reactor != nullptr) && (thread->_reactor != this)) {
+        // Its chain of subscriptions indexes the table of the other reactor
+        fprintf(stderr, "Reactor::monitor(): thread is subscribed to another reactor\n");
+        return;
+    }
 
-    // Notify if this is the first socket we know about
-    SocketSubscriberSet::const_iterator is =
-        _socket_subs.lower_bound(Subscription{fd, nullptr});
-    if ((is == _socket_subs.end()) || (is->fd != fd)) {
+    // Make room for this file descriptor in the dense table
+    if (fd >= int(_sockets.size())) {
+        _sockets.resize(fd + 1);
+    }
+    SocketEntry& entry(_sockets[fd]);
+    SocketList sockets(entry.subs, _subs);
+
+    // Conflate duplicates. There are typically one or two subscribers per socket
+    SocketList::iterator it = sockets.find(
+        [thread](const Subscription& sub) { return sub.thread.get() == thread; });
+    if (it != sockets.end()) {
+        it->tag = tag;
+        if (it->flags != flags) {
+            it->flags = flags;
+            updateFlags(fd);
+        }
+        return;
+    }
+
+    // Notify if this is the first subscription to this socket
+    // otherwise only if it changes the way the socket is watched
+    if (sockets.empty()) {
+        entry.flags = flags;
         onSocketOps(fd, Operation::Added);
+    } else if ((entry.flags | flags) != entry.flags) {
+        entry.flags = entry.flags | flags;
+        onSocketOps(fd, Operation::Modified);
     }
 
     // Insert relationships
-    Subscription sub{fd, thread};
-    _socket_subs.insert(sub);
-    _thread_subs.insert(sub);
+    SubscriptionIndex index = allocate(fd, thread);
+    _subs[index].flags = flags;
+    _subs[index].tag = tag;
+    sockets.push_back(index);
+    ThreadList threads(thread->_subscriptions, _subs);
+    threads.push_back(index);
+    thread->_reactor = this;
+    thread->_scheduler = this;
+}
+
+bool Reactor::isMonitoring(int fd, const LightThread* thread) const {
+    if ((fd < 0) || (fd >= int(_sockets.size()))) return false;
+    SubscriptionIndex index = _sockets[fd].subs.first;
+    while (index != NullIndex) {
+        const Subscription& sub(_subs[index]);
+        if (sub.thread.get() == thread) return true;
+        index = sub.by_socket.next;
+    }
+    return false;
+}
+
+void Reactor::rearm(int fd) {
+    if (hasFlags(socketFlags(fd), MonitorFlags::OneShot)) {
+        onSocketOps(fd, Operation::Modified);
+    }
+}
+
+void Reactor::monitorWritable(int fd, LightThread* thread) {
+    // Keep the flags of an existing subscription
+    if (!isMonitoring(fd, thread)) {
+        monitor(fd, thread, MonitorFlags::None);
+        // Refused if the thread belongs to another reactor
+        if (!isMonitoring(fd, thread)) return;
+    }
+
+    // Writers are flagged on their subscription until they get their event
+    SocketList sockets(_sockets[fd].subs, _subs);
+    SocketList::iterator it = sockets.find(
+        [thread](const Subscription& sub) { return sub.thread.get() == thread; });
+    if (hasFlags(it->flags, MonitorFlags::Writable)) return;
+    it->flags = it->flags | MonitorFlags::Writable;
+    updateFlags(fd);
 }
 
 void Reactor::removeSocket(int fd) {
@@ -42,81 +261,245 @@ void Reactor::removeSocket(int fd) {
     removeSubscriptions(fd);
 }
 
+void Reactor::removeThread(LightThread* th) {
+    assert(th != nullptr && "Thread must not be null");
+    removeSubscriptions(th);
+}
+
 void Reactor::removeSubscriptions(int fd) {
     assert(fd >= 0 && "File descriptor must be valid");
-    // Get the first subscription for this file descriptor
-    SocketSubscriberSet::const_iterator first =
-        _socket_subs.lower_bound(Subscription{fd, nullptr});
+    if (fd >= int(_sockets.size())) return;
+    SocketList sockets(_sockets[fd].subs, _subs);
+    if (sockets.empty()) return;
 
-    // Iterate until the end of set or until the descriptor is a different one
-    SocketSubscriberSet::const_iterator is = first;
-    for (; (is != _socket_subs.end()) && (is->fd == fd); ++is) {
-        _thread_subs.erase(Subscription{fd, is->thread});
+    // Unlink every subscription from both its chains
+    SubscriptionIndex index = _sockets[fd].subs.first;
+    while (index != NullIndex) {
+        SubscriptionIndex next = sockets.remove(index);
+        LightThread* th = _subs[index].thread.get();
+        ThreadList threads(th->_subscriptions, _subs);
+        threads.remove(index);
+        if (threads.empty()) {
+            th->_reactor = nullptr;
+        }
+        release(index);
+        index = next;
     }
-    // Erase all range of subscriptions
-    _socket_subs.erase(first, is);
     onSocketOps(fd, Operation::Removed);
+    _sockets[fd].flags = MonitorFlags::None;
 }
 
 void Reactor::removeSubscriptions(LightThread* th) {
     assert(th != nullptr && "Thread must not be null");
-    // Get the first subscription for this thread
-    ThreadSubscriptionSet::const_iterator first =
-        _thread_subs.lower_bound(Subscription{-1, th});
-
-    // Track which FDs had their last subscription removed
-    // Use a small inline set to avoid allocation for common case
-    FlatSet<int> fds_to_remove(_mem);
-
-    // Iterate until the end of the set or until the thread in the iterator
-    // is a different one
-    ThreadSubscriptionSet::const_iterator it = first;
-    for (; (it != _thread_subs.end()) && (it->thread.get() == th); ++it) {
-        int fd = it->fd;
-        // Remove from socket subscriptions (we know it exists)
-        _socket_subs.erase(Subscription{fd, th});
+    if (th->_reactor != this) return;
 
+    // Unlink every subscription from both its chains
+    // Releasing the last subscription might destroy the thread so we
+    // do not touch it after that
+    ThreadList threads(th->_subscriptions, _subs);
+    SubscriptionIndex index = th->_subscriptions.first;
+    while (index != NullIndex) {
+        SubscriptionIndex next = threads.remove(index);
+        if (next == NullIndex) {
+            th->_reactor = nullptr;
+        }
+        int fd = _subs[index].fd;
+        MonitorFlags flags = _subs[index].flags;
+        SocketList sockets(_sockets[fd].subs, _subs);
+        sockets.remove(index);
+        release(index);
         // Check if this was the last subscription for this FD
-        SocketSubscriberSet::const_iterator next_sub =
-            _socket_subs.lower_bound(Subscription{fd, nullptr});
-        if ((next_sub == _socket_subs.end()) || (next_sub->fd != fd)) {
-            // No more subscriptions for this FD
-            fds_to_remove.insert(fd);
+        if (sockets.empty()) {
+            onSocketOps(fd, Operation::Removed);
+            _sockets[fd].flags = MonitorFlags::None;
+        } else if (flags != MonitorFlags::None) {
+            updateFlags(fd);
         }
+        index = next;
     }
-    // Erase the entire range from thread subscriptions
-    _thread_subs.erase(first, it);
+}
 
-    // Notify about removed sockets
-    for (int fd : fds_to_remove) {
-        onSocketOps(fd, Operation::Removed);
+void Reactor::updateFlags(int fd) {
+    // Removed slots are unlinked already so they do not count
+    SocketEntry& entry(_sockets[fd]);
+    MonitorFlags flags = MonitorFlags::None;
+    for (SubscriptionIndex index = entry.subs.first; index != NullIndex;
+         index = _subs[index].by_socket.next) {
+        flags = flags | _subs[index].flags;
+    }
+    if (flags != entry.flags) {
+        entry.flags = flags;
+        onSocketOps(fd, Operation::Modified);
     }
 }
 
 void Reactor::notifyEvent(int fd, EventType type) {
     assert(fd >= 0 && "File descriptor must be valid");
+    if (fd >= int(_sockets.size())) return;
     Event event;
     event.type = type;
     event.fd = fd;
 
-    // Finds the first subscription to this file descriptor
-    SocketSubscriberSet::const_iterator it =
-        _socket_subs.lower_bound(Subscription{fd, nullptr});
-
     // Iterates over all subscriptions to this file descriptor
-    using ThreadSet = FlatSet<Pointer<LightThread>>;
-    ThreadSet removed(_mem);
-    for (; (it != _socket_subs.end()) && (it->fd == fd); ++it) {
-        if (!it->thread->resume(&event)) {
-            // We cannot remove subscriptions here as it will
-            // invalidate these iterators
-            removed.insert(it->thread);
+    // Threads can subscribe and unsubscribe while they run so we only hold
+    // on to indices. Removed slots are not reused until we are done.
+    // Nested dispatches append to the scratch list after our own entries.
+    std::size_t first_completed = _completed.size();
+    _dispatching += 1;
+    // Writable events only go to the threads waiting for them, once
+    const bool writable = (type == EventType::SocketWriteable);
+    SubscriptionIndex index = _sockets[fd].subs.first;
+    while (index != NullIndex) {
+        Subscription& sub(_subs[index]);
+        LightThread* thread = sub.thread.get();
+        if (writable) {
+            if (!hasFlags(sub.flags, MonitorFlags::Writable)) thread = nullptr;
+            sub.flags = sub.flags & ~MonitorFlags::Writable;
         }
+        event.tag = sub.tag;
+        if ((thread != nullptr) && !thread->resume(&event)) {
+            // Thread is done - clean up its subscriptions after the loop
+            _completed.push_back(index);
+        }
+        index = _subs[index].by_socket.next;
     }
-    for (const Pointer<LightThread>& th : removed) {
-        removeSubscriptions(th.get());
+    _dispatching -= 1;
+
+    // Stop asking for writable events if nobody waits anymore
+    if (writable && hasFlags(_sockets[fd].flags, MonitorFlags::Writable)) {
+        updateFlags(fd);
     }
+
+    // Remove the threads that completed. We kept slots instead of pointers
+    // so we do not touch reference counters. If the slot lost its thread,
+    // someone else already removed it.
+    for (std::size_t j = first_completed; j < _completed.size(); ++j) {
+        LightThread* thread = _subs[_completed[j]].thread.get();
+        if (thread != nullptr) {
+            removeSubscriptions(thread);
+        }
+    }
+    _completed.resize(first_completed);
+
+    // Slots released during the dispatch can now be reused
+    if (_dispatching == 0) {
+        recycle();
+    }
+
     if ((type == EventType::SocketError) || (type == EventType::SocketHangup)) {
         removeSubscriptions(fd);
     }
 }
+
+void Reactor::queueEvent(int fd, EventType type) {
+    assert(fd >= 0 && "File descriptor must be valid");
+    if (fd >= int(_sockets.size())) return;
+    Event event;
+    event.type = type;
+    event.fd = fd;
+
+    // Nothing runs while we queue so all subscriptions in the chain are live
+    const bool writable = (type == EventType::SocketWriteable);
+    for (SubscriptionIndex index = _sockets[fd].subs.first; index != NullIndex;
+         index = _subs[index].by_socket.next) {
+        Subscription& sub(_subs[index]);
+        if (writable) {
+            if (!hasFlags(sub.flags, MonitorFlags::Writable)) continue;
+            sub.flags = sub.flags & ~MonitorFlags::Writable;
+        }
+        LightThread* thread = sub.thread.get();
+        if (thread->_batch_count == 0) {
+            _batch_threads.push_back(thread);
+        }
+        thread->_batch_count += 1;
+        event.tag = sub.tag;
+        _pending.push_back(PendingEvent{thread, event});
+    }
+}
+
+void Reactor::flushEvents() {
+    if (_pending.empty()) return;
+
+    // Lay out the events of each thread next to each other, in arrival order
+    std::uint32_t offset = 0;
+    for (Pointer<LightThread>& thread : _batch_threads) {
+        thread->_batch_offset = offset;
+        offset += thread->_batch_count;
+        thread->_batch_count = 0;
+    }
+    _batch_events.resize(offset);
+    for (const PendingEvent& pending : _pending) {
+        LightThread* thread = pending.thread;
+        _batch_events[thread->_batch_offset + thread->_batch_count] = pending.event;
+        thread->_batch_count += 1;
+    }
+
+    // Resume each thread once. Threads removed by the ones before are skipped
+    std::size_t first_completed = _completed.size();
+    _dispatching += 1;
+    for (Pointer<LightThread>& thread : _batch_threads) {
+        Event& first(_batch_events[thread->_batch_offset]);
+        first.count = thread->_batch_count;
+        thread->_batch_count = 0;
+        if ((thread->_reactor == this) && !thread->resume(&first) &&
+            (thread->_subscriptions.first != NullIndex)) {
+            // Thread is done - any of its slots will do to find it later.
+            // It might have dropped all its subscriptions before finishing
+            _completed.push_back(thread->_subscriptions.first);
+        }
+    }
+    _dispatching -= 1;
+
+    // Same cleanup as notifyEvent() but for all the events at once
+    for (std::size_t j = first_completed; j < _completed.size(); ++j) {
+        LightThread* thread = _subs[_completed[j]].thread.get();
+        if (thread != nullptr) {
+            removeSubscriptions(thread);
+        }
+    }
+    _completed.resize(first_completed);
+    for (const PendingEvent& pending : _pending) {
+        int fd = pending.event.fd;
+        switch (pending.event.type) {
+            case EventType::SocketError:
+            case EventType::SocketHangup: removeSubscriptions(fd); break;
+            case EventType::SocketWriteable:
+                if (hasFlags(_sockets[fd].flags, MonitorFlags::Writable)) {
+                    updateFlags(fd);
+                }
+                break;
+            case EventType::SocketRead:
+            case EventType::Wakeup:
+            case EventType::Timeout:
+            case EventType::ErrorQueue:
+            case EventType::NA: break;
+        }
+    }
+    _pending.clear();
+    _batch_threads.clear();
+    if (_dispatching == 0) {
+        recycle();
+    }
+}
+
+EventType Reactor::errorEvent(int fd) const {
+    if (!hasFlags(socketFlags(fd), MonitorFlags::ErrorQueue)) {
+        return EventType::SocketError;
+    }
+    // A pending socket error wins, reading it also clears it
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if ((::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0) && (error == 0)) {
+        return EventType::ErrorQueue;
+    }
+    return EventType::SocketError;
+}
+
+void Reactor::recycle() {
+    ThreadList retired(_retired, _subs);
+    ThreadList freelist(_free, _subs);
+    for (SubscriptionIndex index = retired.pop_front(); index != NullIndex;
+         index = retired.pop_front()) {
+        freelist.push_back(index);
+    }
+}
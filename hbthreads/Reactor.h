@@ -1,10 +1,54 @@
 #pragma once
 
 #include "ImportedTypes.h"
+#include "IntrusiveIndexList.h"
 #include "LightThread.h"
+#include "TimerWheel.h"
 
 namespace hbthreads {
 
+//! Options of a subscription, which can be or'ed together.
+//! A socket is watched with the union of the flags of all its subscriptions,
+//! so EdgeTriggered, OneShot and Exclusive asked by one subscriber change how
+//! events are delivered to every other subscriber of the same socket. Sockets
+//! shared between threads should be monitored with the same flags by all.
+//! Reactors that cannot honor a flag ignore it.
+enum class MonitorFlags : std::uint8_t {
+    None = 0,           //! level triggered, report while there is data
+    EdgeTriggered = 1,  //! report only when new data arrives
+    OneShot = 2,        //! report once, then nothing until `Reactor::rearm()`
+    Exclusive = 4,      //! wake up only one of the reactors watching the socket
+    Writable = 8,       //! also report room to write, see LightThread::awaitWritable()
+    ErrorQueue = 16     //! report error queue messages as ErrorQueue, see ZeroCopySender
+};
+
+//! Combines two sets of flags
+constexpr MonitorFlags operator|(MonitorFlags lhs, MonitorFlags rhs) {
+    return MonitorFlags(std::uint8_t(lhs) | std::uint8_t(rhs));
+}
+
+//! Returns the flags present in both sets
+constexpr MonitorFlags operator&(MonitorFlags lhs, MonitorFlags rhs) {
+    return MonitorFlags(std::uint8_t(lhs) & std::uint8_t(rhs));
+}
+
+//! Returns all the flags not in the set
+constexpr MonitorFlags operator~(MonitorFlags flags) {
+    return MonitorFlags(std::uint8_t(~std::uint8_t(flags)));
+}
+
+//! Returns true if any of the `bits` is set in `flags`
+constexpr bool hasFlags(MonitorFlags flags, MonitorFlags bits) {
+    return (flags & bits) != MonitorFlags::None;
+}
+
+//! Scheduling class of threads in the run queue. Higher priorities run first
+enum class RunPriority : std::uint8_t {
+    High = 0,    //! latency critical
+    Normal = 1,  //! the default
+    Low = 2      //! housekeeping
+};
+
 //! Base class for all reactor types - currently Epoll and Poll
 //! A reactor or dispatcher is an object that watches over a pool of resources,
 //! which in Unix is a collection of file descriptors, and accepts subscriptions
@@ -15,10 +59,17 @@ namespace hbthreads {
 //! itself, it is up to the derived classes to do it.
 //! The purpose of this base class is only to manage subscriptions and dispatch
 //! events properly to the light threads (coroutines)
-//! TODO:
-//! This reactor does not currently deal with OUT/WRITE notifications, which
-//! are notifications that your application would like to get when there is
-//! space to write data without blocking
+//! Subscriptions are kept in a dense table indexed by file descriptor and
+//! chained intrusively both per descriptor and per thread, so subscribing,
+//! unsubscribing and dispatching do not depend on the number of subscriptions.
+//! Writable notifications are only requested from the kernel while some thread
+//! waits in `awaitWritable()`, otherwise sockets would be reported all the time.
+//! Threads can also be resumed without a file descriptor through the run queue,
+//! see `post()` and `yield()`. Derived classes run it at the end of `work()` and
+//! do not block polling while it is not empty.
+//! Timers live in a timing wheel and are checked along with the run queue, the
+//! poll timeout is shortened to the next one so they cost no file descriptor and
+//! the ones expiring while polling fire in the same `work()`.
 class Reactor : public Object {
 public:
     //! Takes a memory storage to allocate small objects. This storage can be
@@ -29,8 +80,18 @@ public:
     virtual ~Reactor();
 
     //! Set up one subscription. Duplicate subscriptions (same fd and thread)
-    //! will be conflated in a set.
-    void monitor(int fd, LightThread* thread);
+    //! will be conflated, the latest flags and tag win.
+    //! A thread can only be subscribed to one reactor at a time, as its
+    //! subscriptions are chained through the thread itself. Subscribing it to
+    //! another one prints an error and does nothing: remove it from the first
+    //! reactor with `removeThread()` before moving it.
+    //! The tag is handed back in `Event::tag` so threads watching many sockets
+    //! can find their session state without looking up the file descriptor.
+    void monitor(int fd, LightThread* thread, MonitorFlags flags = MonitorFlags::None,
+                 std::uint64_t tag = 0);
+
+    //! Returns true if the thread is subscribed to this file descriptor
+    bool isMonitoring(int fd, const LightThread* thread) const;
 
     //! Remove all active subscriptions to this file descriptor
     void removeSocket(int fd);
@@ -38,9 +99,62 @@ public:
     //! removes all subscriptions to the given thread
     void removeThread(LightThread* othread);
 
-    //! Returns true if there is at least one single subscription active
+    //! Arms a OneShot socket again once its subscribers are ready for the
+    //! next event, typically after draining it. Does nothing on other sockets
+    void rearm(int fd);
+
+    //! Asks for one SocketWriteable event on this socket for this thread,
+    //! subscribing it if needed. Used by `LightThread::awaitWritable()`
+    void monitorWritable(int fd, LightThread* thread);
+
+    //! Returns true if there is at least one single subscription active,
+    //! a thread waiting in the run queue or an armed timer
     bool active() const noexcept;
 
+    //! Schedules the thread to be resumed with this event on the next `work()`.
+    //! Threads run by priority then in the order they were posted.
+    //! The thread does not need to be subscribed. If it finishes it is removed
+    //! from its reactor.
+    void post(LightThread* thread, const Event& event,
+              RunPriority priority = RunPriority::Normal);
+
+    //! Re-queues the current thread with a Wakeup event and suspends it.
+    //! Returns the events it is resumed with, which can be socket events
+    //! arriving first - the Wakeup then comes on a later wait
+    Event* yield(RunPriority priority = RunPriority::Normal);
+
+    //! Returns true if there are threads in the run queue
+    bool runnable() const noexcept;
+
+    //! Identifies an armed timer
+    using TimerId = TimerWheel::TimerId;
+
+    //! Resumes the thread with a Timeout event once the monotonic clock reaches
+    //! `deadline`. The event carries the id in `Event::timer`
+    TimerId addTimer(LightThread* thread, DateTime deadline);
+
+    //! Disarms the timer. Returns false if it already fired or was cancelled
+    bool cancelTimer(TimerId id);
+
+    //! Suspends the current thread until the monotonic clock reaches `deadline`.
+    //! Other events arriving in the meantime are dropped
+    void sleepUntil(DateTime deadline);
+
+    //! Suspends the current thread for `interval`, see `sleepUntil()`
+    void sleepFor(DateTime interval);
+
+    //! Batch mode: the events found in one `work()` call are collected per thread
+    //! and each thread is resumed once with all of its events, which saves one
+    //! context switch per extra ready socket. Off by default.
+    void setBatching(bool enabled) noexcept {
+        _batching = enabled;
+    }
+
+    //! Returns true if events are delivered in batches
+    bool batching() const noexcept {
+        return _batching;
+    }
+
 private:
     //! removes all subscriptions to this thread
     void removeSubscriptions(LightThread* thread);
@@ -48,6 +162,9 @@ private:
     //! removes all subscriptions to this file descriptor
     void removeSubscriptions(int fd);
 
+    //! Recomputes the flags of a socket after one of its subscriptions changed
+    void updateFlags(int fd);
+
 protected:
     //! Type of operations valid on sockets
     enum class Operation : std::uint8_t { NA = 0, Added = 1, Removed = 2, Modified = 3 };
@@ -59,49 +176,146 @@ protected:
     //! notify all subscribers of this file descriptor about a read available
     void notifyEvent(int fd, EventType type);
 
+    //! Queues the event for all subscribers of this file descriptor until
+    //! `flushEvents()` is called
+    void queueEvent(int fd, EventType type);
+
+    //! Resumes every thread with queued events once, with all of them
+    void flushEvents();
+
+    //! Fires the expired timers then resumes the threads posted so far. Threads
+    //! posted meanwhile wait for the next call so yielding threads cannot starve
+    //! the sockets. Derived classes should not block polling if `runnable()`
+    void runQueued();
+
+    //! Shortens the poll timeout to the next timer, rounded up to milliseconds.
+    //! A negative timeout blocks until the next timer if there is one
+    DateTime pollTimeout(DateTime timeout) const;
+
+    //! Notifies right away or queues the event if batching
+    //! Derived classes call this for every event then `flushEvents()` at the end
+    void deliverEvent(int fd, EventType type) {
+        if (_batching) {
+            queueEvent(fd, type);
+        } else {
+            notifyEvent(fd, type);
+        }
+    }
+
+    //! Tells a socket error from messages waiting in the error queue, such as
+    //! MSG_ZEROCOPY completions. Only sockets subscribed with
+    //! MonitorFlags::ErrorQueue are checked, it costs one getsockopt()
+    EventType errorEvent(int fd) const;
+
+    //! Returns the flags the socket should be watched with
+    MonitorFlags socketFlags(int fd) const noexcept {
+        return fd < int(_sockets.size()) ? _sockets[fd].flags : MonitorFlags::None;
+    }
+
     //! A specific operation on a specific file descriptor
     struct FileOps {
         int fd;            //! the file descriptor
         Operation action;  //! the operation
     };
 
+    //! Subscriptions are referred to by their position in `_subs`
+    using SubscriptionIndex = std::uint32_t;
+
+    //! Intrusive hook linking subscriptions by file descriptor or by thread
+    using SubscriptionHook = IntrusiveIndexListHook<SubscriptionIndex>;
+
+    //! Head of a chain of subscriptions
+    using SubscriptionHead = IntrusiveIndexListHead<SubscriptionIndex>;
+
     //! A connection between a file descriptor and a light thread
+    //! A removed subscription has a null thread. It keeps its `by_socket` link
+    //! so a dispatch loop sitting on it can still move on to the next one.
     struct Subscription {
         int fd;                       //! the file descriptor
         Pointer<LightThread> thread;  //! the light thread (coroutine)
+        SubscriptionHook by_socket;   //! chain of subscriptions to the same fd
+        SubscriptionHook by_thread;   //! chain of subscriptions of the same thread
+        MonitorFlags flags;           //! how the subscriber wants to be notified
+        std::uint64_t tag;            //! handed back to the subscriber in events
     };
 
-    //! A functor that will sort by file descriptor first and thread second
-    struct SubscriptionBySocket {
-        bool operator()(const Subscription& lhs, const Subscription& rhs) const {
-            if (lhs.fd < rhs.fd) return true;
-            if (lhs.fd > rhs.fd) return false;
-            return lhs.thread.get() < rhs.thread.get();
-        }
+    //! Everything we know about one file descriptor
+    struct SocketEntry {
+        SubscriptionHead subs;  //! chain of subscriptions to this fd
+        MonitorFlags flags = MonitorFlags::None;  //! union of all subscriptions flags
     };
 
-    //! A functor that will sort by thread first and file descriptor second
-    struct SubscriptionByThread {
-        // Remember: nullptr is often but not guaranteed to be zero!
-        // If this fails I suggest you reevaluate your career choices
-        static_assert(nullptr == (void*)0,
-                      "We need nullptr to be zero so this pointer works as an index");
-        bool operator()(const Subscription& lhs, const Subscription& rhs) const {
-            if (lhs.thread.get() < rhs.thread.get()) return true;
-            if (lhs.thread.get() > rhs.thread.get()) return false;
-            return lhs.fd < rhs.fd;
-        }
+    //! The storage for all subscriptions, live or free
+    using SubscriptionVector = Vector<Subscription>;
+
+    //! Manages the chain of subscriptions to one file descriptor
+    using SocketList = IntrusiveIndexList<Subscription, SubscriptionIndex,
+                                          &Subscription::by_socket, SubscriptionVector>;
+
+    //! Manages the chain of subscriptions of one thread, also used for free lists
+    using ThreadList = IntrusiveIndexList<Subscription, SubscriptionIndex,
+                                          &Subscription::by_thread, SubscriptionVector>;
+
+    //! Null index, marks the end of chains
+    static constexpr SubscriptionIndex NullIndex = SubscriptionHead::NullIndex;
+
+private:
+    //! Returns a subscription slot from the free list or creates a new one
+    SubscriptionIndex allocate(int fd, LightThread* thread);
+
+    //! Returns the slot to the free list. Slots released while an event is
+    //! being dispatched are put aside until the dispatch is finished.
+    void release(SubscriptionIndex index);
+
+    //! Moves the slots released during dispatches to the free list
+    void recycle();
+
+    //! Initial capacity of the completed threads scratch list
+    static constexpr std::size_t CompletedCapacity = 64;
+
+    //! Initial capacity of the batch lists
+    static constexpr std::size_t BatchCapacity = 256;
+
+    //! An event waiting for its thread in batch mode
+    struct PendingEvent {
+        LightThread* thread;  //! the subscriber, kept alive by `_batch_threads`
+        Event event;          //! what happened
     };
 
-    //! A set of subscriptions ordered by file descriptor
-    using SocketSubscriberSet = FlatSet<Subscription, SubscriptionBySocket>;
+    //! A thread in the run queue
+    struct RunEntry {
+        Pointer<LightThread> thread;  //! who to resume
+        Event event;                  //! what with
+    };
+
+    //! Number of RunPriority values
+    static constexpr std::size_t NumPriorities = 3;
+
+    //! Initial capacity of each run queue
+    static constexpr std::size_t RunCapacity = 64;
+
+protected:
+    MemoryStorage* _mem;        //! The memory resource where to allocate from
+    SubscriptionVector _subs;   //! All subscription slots
+    Vector<SocketEntry> _sockets;  //! Per file descriptor subscription chains
+    SubscriptionHead _free;     //! Slots ready for reuse
+    SubscriptionHead _retired;  //! Slots released during the current dispatch
+    std::uint32_t _num_subs;    //! Number of live subscriptions
+    std::uint32_t _dispatching;  //! Depth of nested notifyEvent() calls
+
+    //! Scratch list with one slot of each thread that completed during a dispatch.
+    //! It is reused across calls so dispatching does not allocate.
+    Vector<SubscriptionIndex> _completed;
+
+    bool _batching;                              //! Are we batching events?
+    Vector<PendingEvent> _pending;               //! Queued events in arrival order
+    Vector<Pointer<LightThread>> _batch_threads;  //! Threads with queued events
+    Vector<Event> _batch_events;                 //! Queued events grouped by thread
 
-    //! A set of subscriptions ordered by thread
-    using ThreadSubscriptionSet = FlatSet<Subscription, SubscriptionByThread>;
+    Vector<RunEntry> _run_queues[NumPriorities];  //! Posted threads, per priority
+    Vector<RunEntry> _running;  //! The run queue being resumed, swapped in
 
-    MemoryStorage* _mem;               //! The memory resource where to allocate from
-    SocketSubscriberSet _socket_subs;  //! Set of subscriptions ordered by file descriptor
-    ThreadSubscriptionSet _thread_subs;  //! Set of subscriptions ordered by thread
+    TimerWheel _timers;  //! Armed timers
 };
 
-}  // namespace hbthreads
\ No newline at end of file
+}  // namespace hbthreads
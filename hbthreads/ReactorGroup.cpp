@@ -0,0 +1,171 @@
+#include "ReactorGroup.h"
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace hbthreads;
+
+// The core the current OS thread is running
+static __thread ReactorGroup::Core* local_core = nullptr;
+
+namespace {
+
+// Resets the doorbell counter so the reactor stops reporting it
+// The messages themselves are processed by the core loop after work()
+class Doorbell : public LightThread {
+public:
+    void run() override {
+        while (true) {
+            for (const Event& ev : *wait()) {
+                eventfd_t value;
+                eventfd_read(ev.fd, &value);
+            }
+        }
+    }
+};
+
+}  // namespace
+
+ReactorGroup::ReactorGroup(const std::vector<int>& cpus, DateTime timeout)
+    : _timeout(timeout), _ready(0) {
+    for (std::size_t j = 0; j < cpus.size(); ++j) {
+        std::unique_ptr<CoreData> data(new CoreData);
+        data->core.index = j;
+        data->core.cpu = cpus[j];
+        data->core.reactor = nullptr;
+        data->core.group = this;
+        data->doorbell = ::eventfd(0, EFD_NONBLOCK);
+        if (data->doorbell < 0) {
+            perror("ReactorGroup::ReactorGroup() on eventfd");
+        }
+        data->running = false;
+        data->inbox.reserve(MailboxCapacity);
+        data->outbox.reserve(MailboxCapacity);
+        _cores.push_back(std::move(data));
+    }
+}
+
+ReactorGroup::~ReactorGroup() {
+    stop();
+    for (std::unique_ptr<CoreData>& data : _cores) {
+        if (data->doorbell >= 0) ::close(data->doorbell);
+    }
+}
+
+ReactorGroup::Core* ReactorGroup::local() noexcept {
+    return local_core;
+}
+
+void ReactorGroup::start(SetupFunction setup, void* arg) {
+    _ready = 0;
+    for (std::unique_ptr<CoreData>& data : _cores) {
+        data->running = true;
+        CoreData* ptr = data.get();
+        data->thread = std::thread([this, ptr, setup, arg]() { run(*ptr, setup, arg); });
+    }
+    // Setup code might post to other cores so they all have to be up
+    while (_ready.load(std::memory_order_acquire) < _cores.size()) {
+        std::this_thread::yield();
+    }
+}
+
+void ReactorGroup::stop() {
+    for (std::unique_ptr<CoreData>& data : _cores) {
+        if (!data->thread.joinable()) continue;
+        data->running.store(false, std::memory_order_release);
+        eventfd_write(data->doorbell, 1);
+    }
+    for (std::unique_ptr<CoreData>& data : _cores) {
+        if (data->thread.joinable()) data->thread.join();
+    }
+}
+
+void ReactorGroup::post(std::size_t core, Function function, void* arg) {
+    send(core, Message{function, arg, nullptr});
+}
+
+void ReactorGroup::wake(std::size_t core, LightThread* thread) {
+    send(core, Message{nullptr, nullptr, thread});
+}
+
+void ReactorGroup::send(std::size_t core, const Message& message) {
+    assert(core < _cores.size() && "Core index out of range");
+    CoreData& data(*_cores[core]);
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(data.mutex);
+        first = data.inbox.empty();
+        data.inbox.push_back(message);
+    }
+    // If the inbox was not empty the doorbell was rung already
+    if (first) {
+        eventfd_write(data.doorbell, 1);
+    }
+}
+
+void ReactorGroup::run(CoreData& data, SetupFunction setup, void* arg) {
+    // Pin before allocating anything so memory is local to the cpu
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(data.core.cpu, &cpuset);
+    int res = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (res != 0) {
+        fprintf(stderr, "ReactorGroup::run() could not pin to cpu %d: %s\n",
+                data.core.cpu, strerror(res));
+    }
+
+    // Every core has its own unsynchronized pools
+    boost::container::pmr::monotonic_buffer_resource pool(64 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+    {
+        Pointer<EpollReactor> reactor(new EpollReactor(storage, _timeout));
+        Pointer<Doorbell> doorbell(new Doorbell);
+        doorbell->start(16 * 1024);
+        reactor->monitor(data.doorbell, doorbell.get());
+        data.core.reactor = reactor.get();
+        local_core = &data.core;
+
+        if (setup != nullptr) {
+            setup(data.core, arg);
+        }
+        _ready.fetch_add(1, std::memory_order_release);
+
+        while (data.running.load(std::memory_order_acquire)) {
+            reactor->work();
+            drain(data);
+        }
+        drain(data);
+
+        // Release all light threads while the storage is still around
+        local_core = nullptr;
+        data.core.reactor = nullptr;
+    }
+    storage = nullptr;
+}
+
+void ReactorGroup::drain(CoreData& data) {
+    // Take everything at once so senders are not held while we run
+    {
+        std::lock_guard<std::mutex> lock(data.mutex);
+        if (data.inbox.empty()) return;
+        data.inbox.swap(data.outbox);
+    }
+    EpollReactor* reactor = data.core.reactor;
+    for (const Message& message : data.outbox) {
+        if (message.thread != nullptr) {
+            // Through the run queue like any other wakeup. It holds the thread
+            // and drops it if it is done by the time its turn comes
+            Event event;
+            event.type = EventType::Wakeup;
+            event.fd = -1;
+            reactor->post(message.thread, event);
+        } else {
+            message.function(message.arg);
+        }
+    }
+    data.outbox.clear();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "DateTime.h"
+#include "EpollReactor.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hbthreads {
+
+//! Runs one EpollReactor per cpu, thread-per-core style.
+//! Every core is an OS thread pinned to its cpu with its own memory storage and
+//! reactor, so light threads and everything they allocate stay on that core and
+//! need no locking. The only way across cores is the mailbox: any thread can
+//! post a function to run on a core or wake up a light thread living there.
+//! The mailbox is rung through an eventfd watched by the core's reactor.
+class ReactorGroup {
+public:
+    //! Work posted to a core, runs on that core outside any light thread
+    using Function = void (*)(void* arg);
+
+    //! What a core exposes to the code running on it
+    struct Core {
+        std::size_t index;      //! position in the group
+        int cpu;                //! cpu this core is pinned to
+        EpollReactor* reactor;  //! the core's reactor
+        ReactorGroup* group;    //! the group this core belongs to
+    };
+
+    //! Runs once on each core before its loop starts, to create light threads
+    //! and subscriptions with the core's storage
+    using SetupFunction = void (*)(Core& core, void* arg);
+
+    //! One core per entry in `cpus`. `timeout` is how long each reactor blocks
+    ReactorGroup(const std::vector<int>& cpus, DateTime timeout = DateTime::msecs(100));
+
+    //! Stops and joins all cores
+    ~ReactorGroup();
+
+    ReactorGroup(const ReactorGroup&) = delete;
+    ReactorGroup& operator=(const ReactorGroup&) = delete;
+
+    //! Starts all cores, returns once they all ran `setup`
+    void start(SetupFunction setup, void* arg);
+
+    //! Asks all cores to finish and waits for them. Light threads still
+    //! subscribed are released by their reactor on their own core.
+    void stop();
+
+    //! Number of cores
+    std::size_t size() const noexcept {
+        return _cores.size();
+    }
+
+    //! Runs `function(arg)` on the given core. Callable from any thread
+    void post(std::size_t core, Function function, void* arg);
+
+    //! Posts `thread` on the run queue of the given core with an EventType::Wakeup
+    //! event, so it runs on the next `work()` there. The thread must live on that
+    //! core and stay alive until the core got the message. Callable from any thread
+    void wake(std::size_t core, LightThread* thread);
+
+    //! Returns the core the calling thread runs on, null outside the group
+    static Core* local() noexcept;
+
+private:
+    //! A mailbox entry. Either a function or a thread to resume
+    struct Message {
+        Function function;
+        void* arg;
+        LightThread* thread;
+    };
+
+    //! Everything about one core. Only the mailbox is shared
+    struct CoreData {
+        Core core;                       //! the public part
+        std::thread thread;              //! the OS thread
+        int doorbell;                    //! eventfd to wake up the reactor
+        std::atomic<bool> running;       //! cleared to stop the loop
+        std::mutex mutex;                //! protects the inbox
+        std::vector<Message> inbox;      //! messages posted to this core
+        std::vector<Message> outbox;     //! messages being processed
+    };
+
+    //! Queues a message and rings the doorbell if the core might be asleep
+    void send(std::size_t core, const Message& message);
+
+    //! The core main loop
+    void run(CoreData& data, SetupFunction setup, void* arg);
+
+    //! Runs all messages in the inbox
+    void drain(CoreData& data);
+
+    //! Initial mailbox capacity, it grows as needed
+    static constexpr std::size_t MailboxCapacity = 256;
+
+    DateTime _timeout;                               //! reactor timeout
+    std::vector<std::unique_ptr<CoreData>> _cores;  //! all cores
+    std::atomic<std::size_t> _ready;                //! cores done with setup
+};
+
+}  // namespace hbthreads
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include "ReactorGroup.h"
+#include <sys/eventfd.h>
+#include <sched.h>
+#include <unistd.h>
+
+using namespace hbthreads;
+
+namespace {
+
+// Finishes on the first wakeup
+class Sleeper : public LightThread {
+public:
+    Sleeper(std::atomic<int>* counter) : wakeups(counter) {
+    }
+    std::atomic<int>* wakeups;
+
+    void run() override {
+        for (const Event& ev : *wait()) {
+            if (ev.type == EventType::Wakeup) (*wakeups)++;
+        }
+    }
+};
+
+// Shared between the test and the cores
+struct TestState {
+    std::atomic<int> setups{0};
+    std::atomic<int> posted{0};
+    std::atomic<int> wrong_core{0};
+    std::atomic<int> wakeups{0};
+    int fds[2] = {-1, -1};
+    LightThread* sleepers[2] = {nullptr, nullptr};
+    Pointer<LightThread> owned[2];
+};
+
+// Creates one sleeper per core, kept alive by a dummy subscription
+void setupCore(ReactorGroup::Core& core, void* arg) {
+    TestState* state = static_cast<TestState*>(arg);
+    Pointer<Sleeper> sleeper(new Sleeper(&state->wakeups));
+    sleeper->start(16 * 1024);
+    core.reactor->monitor(state->fds[core.index], sleeper.get());
+    state->sleepers[core.index] = sleeper.get();
+    state->setups++;
+}
+
+// Same as setupCore() but the state also owns the sleepers, so they outlive
+// their reactor subscription
+void setupOwnedCore(ReactorGroup::Core& core, void* arg) {
+    setupCore(core, arg);
+    TestState* state = static_cast<TestState*>(arg);
+    state->owned[core.index] = state->sleepers[core.index];
+}
+
+// Releases the sleeper of the core it runs on, from that core's storage
+void releaseSleeper(void* arg) {
+    TestState* state = static_cast<TestState*>(arg);
+    state->owned[ReactorGroup::local()->index].reset();
+    state->posted++;
+}
+
+// Checks it runs on the core it was posted to
+struct PostArg {
+    TestState* state;
+    std::size_t core;
+};
+void countPost(void* arg) {
+    PostArg* post = static_cast<PostArg*>(arg);
+    ReactorGroup::Core* core = ReactorGroup::local();
+    if ((core == nullptr) || (core->index != post->core)) post->state->wrong_core++;
+    post->state->posted++;
+}
+
+// Any cpu we are allowed to run on
+int firstCpu() {
+    cpu_set_t cpuset;
+    sched_getaffinity(0, sizeof(cpuset), &cpuset);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpuset)) return cpu;
+    }
+    return 0;
+}
+
+}  // namespace
+
+TEST(ReactorGroupTest, Constructor) {
+    ReactorGroup group({0, 0, 0});
+    EXPECT_EQ(group.size(), 3UL);
+    EXPECT_EQ(ReactorGroup::local(), nullptr);
+}
+
+TEST(ReactorGroupTest, PostAndWake) {
+    TestState state;
+    state.fds[0] = eventfd(0, EFD_NONBLOCK);
+    state.fds[1] = eventfd(0, EFD_NONBLOCK);
+    int cpu = firstCpu();
+    {
+        ReactorGroup group({cpu, cpu}, DateTime::msecs(10));
+        group.start(setupCore, &state);
+        EXPECT_EQ(state.setups, 2);
+
+        PostArg args[2] = {{&state, 0}, {&state, 1}};
+        for (int j = 0; j < 100; ++j) {
+            group.post(j % 2, countPost, &args[j % 2]);
+        }
+        group.wake(0, state.sleepers[0]);
+        group.wake(1, state.sleepers[1]);
+
+        // Wait for the cores to go through their mailboxes
+        for (int j = 0; j < 1000 && (state.posted < 100 || state.wakeups < 2); ++j) {
+            usleep(1000);
+        }
+        group.stop();
+    }
+    EXPECT_EQ(state.posted, 100);
+    EXPECT_EQ(state.wrong_core, 0);
+    EXPECT_EQ(state.wakeups, 2);
+    close(state.fds[0]);
+    close(state.fds[1]);
+}
+
+TEST(ReactorGroupTest, WakeFinishedThread) {
+    TestState state;
+    state.fds[0] = eventfd(0, EFD_NONBLOCK);
+    int cpu = firstCpu();
+    {
+        ReactorGroup group({cpu}, DateTime::msecs(10));
+        group.start(setupOwnedCore, &state);
+        EXPECT_EQ(state.setups, 1);
+
+        // The first wakeup finishes the sleeper, the others are dropped
+        for (int j = 0; j < 3; ++j) {
+            group.wake(0, state.sleepers[0]);
+        }
+        group.post(0, releaseSleeper, &state);
+        for (int j = 0; j < 1000 && state.posted < 1; ++j) {
+            usleep(1000);
+        }
+        group.stop();
+    }
+    EXPECT_EQ(state.wakeups, 1);
+    EXPECT_EQ(state.posted, 1);
+    close(state.fds[0]);
+}
@@ -6,12 +6,16 @@
 
 using namespace hbthreads;
 
+namespace {
+
 // Test thread that counts events
+// Anonymous namespace as other test files also define a TestThread
 class TestThread : public LightThread {
 public:
     int events_received = 0;
     EventType last_event_type = EventType::NA;
     int last_fd = -1;
+    std::uint64_t last_tag = 0;
 
     void run() override {
         while (true) {
@@ -19,10 +23,119 @@ public:
             events_received++;
             last_event_type = ev->type;
             last_fd = ev->fd;
+            last_tag = ev->tag;
+        }
+    }
+};
+
+// Test thread that drains every event of every resume
+class BatchThread : public LightThread {
+public:
+    int resumes = 0;
+    int events_received = 0;
+    std::vector<int> event_fds;
+    std::vector<std::uint64_t> event_tags;
+
+    void run() override {
+        while (true) {
+            resumes++;
+            for (const Event& ev : *wait()) {
+                events_received++;
+                event_fds.push_back(ev.fd);
+                event_tags.push_back(ev.tag);
+                eventfd_t value;
+                eventfd_read(ev.fd, &value);
+            }
+        }
+    }
+};
+
+// Finishes on its first event
+class OneShotThread : public LightThread {
+public:
+    int events_received = 0;
+
+    void run() override {
+        for (const Event& ev : *wait()) {
+            (void)ev;
+            events_received++;
+        }
+    }
+};
+
+// Unsubscribes its sockets on its first event then finishes
+class LeavingThread : public LightThread {
+public:
+    LeavingThread(Reactor* reactor) : reactor(reactor) {
+    }
+    Reactor* reactor;
+    int events_received = 0;
+
+    void run() override {
+        for (const Event& ev : *wait()) {
+            events_received++;
+            reactor->removeSocket(ev.fd);
+        }
+    }
+};
+
+// Appends the fd of every event it gets to a shared log
+class LogThread : public LightThread {
+public:
+    LogThread(std::vector<int>* log) : log(log) {
+    }
+    std::vector<int>* log;
+
+    void run() override {
+        while (true) {
+            log->push_back(wait()->fd);
+        }
+    }
+};
+
+// Yields forever, counting how many times it ran
+class YieldThread : public LightThread {
+public:
+    YieldThread(Reactor* reactor) : reactor(reactor) {
+    }
+    Reactor* reactor;
+    int runs = 0;
+
+    void run() override {
+        while (true) {
+            reactor->yield();
+            runs++;
         }
     }
 };
 
+// Sleeps a number of times then finishes
+class SleepThread : public LightThread {
+public:
+    SleepThread(Reactor* reactor, DateTime interval, int count)
+        : reactor(reactor), interval(interval), count(count) {
+    }
+    Reactor* reactor;
+    DateTime interval;
+    int count;
+
+    void run() override {
+        for (int j = 0; j < count; ++j) {
+            reactor->sleepFor(interval);
+        }
+    }
+};
+
+// Builds a user event
+Event userEvent(int fd) {
+    Event event;
+    event.type = EventType::NA;
+    event.fd = fd;
+    return event;
+}
+
+}  // namespace
+
 class ReactorTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -192,6 +305,38 @@ TEST_F(ReactorTest, DuplicateMonitor) {
     close(fd);
 }
 
+TEST_F(ReactorTest, OneReactorPerThread) {
+    EpollReactor first(buffer, DateTime::msecs(1));
+    EpollReactor second(buffer, DateTime::msecs(1));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(4 * 1024);
+
+    int fd1 = eventfd(0, EFD_NONBLOCK);
+    int fd2 = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd1, 0);
+    ASSERT_GE(fd2, 0);
+    first.monitor(fd1, thread.get());
+
+    // The second reactor refuses the thread and the first one is left intact
+    EXPECT_DEBUG_DEATH(second.monitor(fd2, thread.get()), "another reactor");
+    EXPECT_FALSE(second.isMonitoring(fd2, thread.get()));
+    EXPECT_FALSE(second.active());
+    EXPECT_TRUE(first.isMonitoring(fd1, thread.get()));
+
+    // Once removed from the first it can move
+    first.removeThread(thread.get());
+    second.monitor(fd2, thread.get());
+    EXPECT_TRUE(second.isMonitoring(fd2, thread.get()));
+    uint64_t val = 1;
+    ASSERT_EQ(write(fd2, &val, sizeof(val)), sizeof(val));
+    second.work();
+    EXPECT_EQ(thread->events_received, 1);
+    EXPECT_EQ(thread->last_fd, fd2);
+
+    close(fd1);
+    close(fd2);
+}
+
 TEST_F(ReactorTest, Active) {
     EpollReactor reactor(buffer);
     Pointer<TestThread> thread(new TestThread);
@@ -225,4 +370,267 @@ TEST_F(ReactorTest, WorkWithNoSockets) {
     // Should return without blocking indefinitely
     EXPECT_TRUE(reactor.work());
     EXPECT_FALSE(reactor.active());
-}
\ No newline at end of file
+}
+
+TEST_F(ReactorTest, BatchingResumesOncePerThread) {
+    const int NUM_FDS = 10;
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    reactor.setBatching(true);
+    EXPECT_TRUE(reactor.batching());
+    Pointer<BatchThread> thread1(new BatchThread);
+    Pointer<BatchThread> thread2(new BatchThread);
+    thread1->start(16 * 1024);
+    thread2->start(16 * 1024);
+
+    int fds[NUM_FDS];
+    for (int& fd : fds) {
+        fd = eventfd(0, EFD_NONBLOCK);
+        ASSERT_GE(fd, 0);
+        reactor.monitor(fd, thread1.get());
+    }
+    reactor.monitor(fds[0], thread2.get());
+
+    for (int fd : fds) {
+        eventfd_write(fd, 1);
+    }
+    reactor.work();
+
+    // One resume each (the first one is start()) with all their events
+    EXPECT_EQ(thread1->resumes, 2);
+    EXPECT_EQ(thread1->events_received, NUM_FDS);
+    EXPECT_EQ(thread2->resumes, 2);
+    EXPECT_EQ(thread2->events_received, 1);
+    EXPECT_EQ(thread2->event_fds[0], fds[0]);
+
+    for (int fd : fds) {
+        reactor.removeSocket(fd);
+        close(fd);
+    }
+}
+
+TEST_F(ReactorTest, BatchingRemovesCompletedThreads) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    reactor.setBatching(true);
+    Pointer<OneShotThread> thread(new OneShotThread);
+    thread->start(16 * 1024);
+
+    int fd1 = eventfd(0, EFD_NONBLOCK);
+    int fd2 = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd1, 0);
+    ASSERT_GE(fd2, 0);
+    reactor.monitor(fd1, thread.get());
+    reactor.monitor(fd2, thread.get());
+
+    eventfd_write(fd1, 1);
+    eventfd_write(fd2, 1);
+    reactor.work();
+
+    // Both events came in the same resume, then the thread finished
+    EXPECT_EQ(thread->events_received, 2);
+    EXPECT_FALSE(reactor.active());
+
+    close(fd1);
+    close(fd2);
+}
+
+TEST_F(ReactorTest, BatchingThreadLeavingBeforeFinishing) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    reactor.setBatching(true);
+    Pointer<LeavingThread> thread(new LeavingThread(&reactor));
+    Pointer<BatchThread> other(new BatchThread);
+    thread->start(16 * 1024);
+    other->start(16 * 1024);
+
+    int fd1 = eventfd(0, EFD_NONBLOCK);
+    int fd2 = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd1, 0);
+    ASSERT_GE(fd2, 0);
+    reactor.monitor(fd1, thread.get());
+    reactor.monitor(fd2, other.get());
+
+    eventfd_write(fd1, 1);
+    eventfd_write(fd2, 1);
+    reactor.work();
+
+    // The thread finished with no subscriptions left, the other one goes on
+    EXPECT_EQ(thread->events_received, 1);
+    EXPECT_EQ(other->events_received, 1);
+    EXPECT_TRUE(reactor.active());
+
+    eventfd_write(fd2, 1);
+    reactor.work();
+    EXPECT_EQ(other->events_received, 2);
+
+    reactor.removeSocket(fd2);
+    close(fd1);
+    close(fd2);
+}
+
+TEST_F(ReactorTest, PostRunsByPriority) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    std::vector<int> log;
+    Pointer<LogThread> thread1(new LogThread(&log));
+    Pointer<LogThread> thread2(new LogThread(&log));
+    thread1->start(16 * 1024);
+    thread2->start(16 * 1024);
+
+    reactor.post(thread1.get(), userEvent(3), RunPriority::Low);
+    reactor.post(thread1.get(), userEvent(2));
+    reactor.post(thread2.get(), userEvent(1), RunPriority::High);
+    reactor.post(thread2.get(), userEvent(4));
+    EXPECT_TRUE(reactor.runnable());
+    EXPECT_TRUE(reactor.active());
+
+    reactor.work();
+    EXPECT_EQ(log, (std::vector<int>{1, 2, 4, 3}));
+    EXPECT_FALSE(reactor.runnable());
+    EXPECT_FALSE(reactor.active());
+}
+
+TEST_F(ReactorTest, YieldDoesNotStarveSockets) {
+    // A long timeout to check we do not block while threads are runnable
+    EpollReactor reactor(buffer, DateTime::secs(5));
+    Pointer<YieldThread> yielder(new YieldThread(&reactor));
+    yielder->start(16 * 1024);
+    Pointer<TestThread> reader(new TestThread);
+    reader->start(16 * 1024);
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, reader.get());
+    eventfd_write(fd, 1);
+
+    DateTime start = DateTime::now();
+    for (int j = 0; j < 10; ++j) {
+        reactor.work();
+    }
+    EXPECT_LT((DateTime::now() - start).msecs(), 1000);
+
+    // The yielder ran once per work() and the socket was polled meanwhile
+    EXPECT_EQ(yielder->runs, 10);
+    EXPECT_EQ(reader->events_received, 10);
+    EXPECT_TRUE(reactor.runnable());
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(ReactorTest, PostedThreadFinishing) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    Pointer<OneShotThread> thread(new OneShotThread);
+    thread->start(16 * 1024);
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread.get());
+
+    // The second post finds the thread finished and is dropped
+    reactor.post(thread.get(), userEvent(fd));
+    reactor.post(thread.get(), userEvent(fd));
+    reactor.work();
+    EXPECT_TRUE(thread->finished());
+    EXPECT_EQ(thread->events_received, 1);
+    EXPECT_FALSE(reactor.active());
+    close(fd);
+}
+
+TEST_F(ReactorTest, SleepWithoutSockets) {
+    EpollReactor reactor(buffer, DateTime::secs(5));
+    Pointer<SleepThread> thread(new SleepThread(&reactor, DateTime::msecs(5), 4));
+    DateTime start = DateTime::now(DateTime::ClockType::Monotonic);
+    thread->start(16 * 1024);
+    EXPECT_TRUE(reactor.active());
+
+    // Polling wakes up for the timers, not the reactor timeout
+    int loops = 0;
+    while (!thread->finished() && loops < 1000) {
+        reactor.work();
+        loops++;
+    }
+    DateTime elapsed = DateTime::now(DateTime::ClockType::Monotonic) - start;
+    EXPECT_TRUE(thread->finished());
+    EXPECT_FALSE(reactor.active());
+    EXPECT_GE(elapsed.msecs(), 20);
+    EXPECT_LT(elapsed.msecs(), 2000);
+    EXPECT_LT(loops, 100);
+}
+
+TEST_F(ReactorTest, TimeoutEvents) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    Pointer<TestThread> thread(new TestThread);
+    thread->start(16 * 1024);
+    DateTime now = DateTime::now(DateTime::ClockType::Monotonic);
+    Reactor::TimerId dropped = reactor.addTimer(thread.get(), now);
+    Reactor::TimerId kept = reactor.addTimer(thread.get(), now);
+    EXPECT_TRUE(reactor.cancelTimer(dropped));
+
+    // Deadlines round up to the next tick so it might take a poll or two
+    for (int j = 0; j < 100 && thread->events_received == 0; ++j) {
+        reactor.work();
+    }
+    EXPECT_EQ(thread->events_received, 1);
+    EXPECT_EQ(thread->last_event_type, EventType::Timeout);
+    EXPECT_FALSE(reactor.cancelTimer(kept));
+    EXPECT_FALSE(reactor.active());
+}
+
+TEST_F(ReactorTest, SubscriptionTags) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    Pointer<TestThread> thread1(new TestThread);
+    Pointer<TestThread> thread2(new TestThread);
+    thread1->start(16 * 1024);
+    thread2->start(16 * 1024);
+
+    // Each subscriber gets its own tag
+    int fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+    reactor.monitor(fd, thread1.get(), MonitorFlags::None, 0x1234567890ULL);
+    reactor.monitor(fd, thread2.get(), MonitorFlags::None, 42);
+    eventfd_write(fd, 1);
+    reactor.work();
+    EXPECT_EQ(thread1->last_tag, 0x1234567890ULL);
+    EXPECT_EQ(thread2->last_tag, 42UL);
+
+    // Subscribing again replaces the tag
+    reactor.monitor(fd, thread2.get(), MonitorFlags::None, 7);
+    reactor.work();
+    EXPECT_EQ(thread2->last_tag, 7UL);
+
+    // Posted events carry whatever tag they were given
+    Event event = userEvent(-1);
+    EXPECT_EQ(event.tag, 0UL);
+    event.tag = 99;
+    reactor.post(thread1.get(), event);
+    reactor.work();
+    EXPECT_EQ(thread1->last_tag, 99UL);
+
+    reactor.removeSocket(fd);
+    close(fd);
+}
+
+TEST_F(ReactorTest, BatchingSubscriptionTags) {
+    const int NUM_FDS = 4;
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    reactor.setBatching(true);
+    Pointer<BatchThread> thread(new BatchThread);
+    thread->start(16 * 1024);
+
+    int fds[NUM_FDS];
+    for (int j = 0; j < NUM_FDS; ++j) {
+        fds[j] = eventfd(0, EFD_NONBLOCK);
+        ASSERT_GE(fds[j], 0);
+        reactor.monitor(fds[j], thread.get(), MonitorFlags::None, 100 + j);
+        eventfd_write(fds[j], 1);
+    }
+    reactor.work();
+
+    ASSERT_EQ(thread->event_tags.size(), std::size_t(NUM_FDS));
+    for (int j = 0; j < NUM_FDS; ++j) {
+        int index = 0;
+        while (fds[index] != thread->event_fds[j]) index++;
+        EXPECT_EQ(thread->event_tags[j], std::uint64_t(100 + index));
+    }
+
+    for (int fd : fds) {
+        reactor.removeSocket(fd);
+        close(fd);
+    }
+}
@@ -0,0 +1,96 @@
+#include "RemoteFreePool.h"
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+using namespace hbthreads;
+
+// C++14 needs these defined somewhere in case they are bound to references
+constexpr std::size_t RemoteFreePool::Granularity;
+constexpr std::size_t RemoteFreePool::MaxSize;
+constexpr std::size_t RemoteFreePool::NumClasses;
+constexpr std::size_t RemoteFreePool::SlabSize;
+
+RemoteFreePool::RemoteFreePool(MemoryStorage* upstream)
+    : _upstream(upstream), _slabs(nullptr), _cursor(nullptr), _end(nullptr) {
+    assert(upstream != nullptr && "Upstream storage must not be null");
+    static_assert(sizeof(Slab) % Granularity == 0, "Slab header breaks alignment");
+    for (std::size_t j = 0; j < NumClasses; ++j) {
+        _free[j] = nullptr;
+        _remote[j].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+RemoteFreePool::~RemoteFreePool() {
+    Slab* slab = _slabs;
+    while (slab != nullptr) {
+        Slab* next = slab->next;
+        ::free(slab);
+        slab = next;
+    }
+}
+
+void* RemoteFreePool::do_allocate(std::size_t bytes, std::size_t alignment) {
+    if ((bytes > MaxSize) || (alignment > Granularity)) {
+        return _upstream->allocate(bytes, alignment);
+    }
+    std::size_t cls = sizeClass(bytes);
+    FreeBlock* block = _free[cls];
+    // Take over what other threads gave back in one go
+    if ((block == nullptr) && (_remote[cls].load(std::memory_order_relaxed) != nullptr)) {
+        block = _remote[cls].exchange(nullptr, std::memory_order_acquire);
+    }
+    if (block == nullptr) return carve(cls);
+    _free[cls] = block->next;
+    return block;
+}
+
+void RemoteFreePool::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) {
+    if ((bytes > MaxSize) || (alignment > Granularity)) {
+        _upstream->deallocate(ptr, bytes, alignment);
+        return;
+    }
+    // Slabs are aligned to their size so the header is right below
+    Slab* slab = reinterpret_cast<Slab*>(std::uintptr_t(ptr) & ~(SlabSize - 1));
+    std::size_t cls = sizeClass(bytes);
+    if (slab->owner != this) {
+        slab->owner->pushRemote(cls, ptr);
+        return;
+    }
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = _free[cls];
+    _free[cls] = block;
+}
+
+bool RemoteFreePool::do_is_equal(const MemoryStorage& other) const noexcept {
+    return dynamic_cast<const RemoteFreePool*>(&other) != nullptr;
+}
+
+void* RemoteFreePool::carve(std::size_t cls) {
+    const std::size_t size = (cls + 1) * Granularity;
+    if (size > std::size_t(_end - _cursor)) {
+        // The tail of the current slab is lost, it is smaller than MaxSize
+        void* ptr = ::aligned_alloc(SlabSize, SlabSize);
+        if (ptr == nullptr) throw std::bad_alloc();
+        Slab* slab = static_cast<Slab*>(ptr);
+        slab->owner = this;
+        slab->next = _slabs;
+        _slabs = slab;
+        _cursor = static_cast<char*>(ptr) + sizeof(Slab);
+        _end = static_cast<char*>(ptr) + SlabSize;
+    }
+    void* block = _cursor;
+    _cursor += size;
+    return block;
+}
+
+void RemoteFreePool::pushRemote(std::size_t cls, void* ptr) noexcept {
+    // Many threads push, only the owner takes, and it takes the whole list,
+    // so there is no ABA problem
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    FreeBlock* head = _remote[cls].load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!_remote[cls].compare_exchange_weak(head, block, std::memory_order_release,
+                                                 std::memory_order_relaxed));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "ImportedTypes.h"
+#include <boost/container/pmr/global_resource.hpp>
+#include <atomic>
+#include <cstddef>
+
+namespace hbthreads {
+
+//! A per-thread pool that other threads can free into.
+//! Blocks are carved out of aligned slabs that remember their owner, so any
+//! pool can tell where a block came from. Frees from the owning thread go
+//! straight to its free lists; frees from other threads are pushed on a
+//! lock-free return list per size class that the owner takes over in one swap
+//! when its own list runs dry.
+//! This lets `Pointer<T>` objects allocated on one reactor thread be released
+//! on another, as long as every thread involved uses one of these pools as its
+//! `storage`. Each pool must only allocate from its own thread and must outlive
+//! all the blocks it handed out, wherever they are freed.
+//! Size classes are `Granularity` bytes apart, which covers objects up to
+//! `MaxSize` bytes. Larger or more aligned requests go to the upstream
+//! resource, which must be thread safe.
+class RemoteFreePool : public MemoryStorage {
+public:
+    //! Distance between size classes, also the alignment of all blocks
+    static constexpr std::size_t Granularity = 16;
+
+    //! Largest block served from the slabs
+    static constexpr std::size_t MaxSize = 1024;
+
+    //! Number of size classes
+    static constexpr std::size_t NumClasses = MaxSize / Granularity;
+
+    //! Size and alignment of the slabs blocks are carved from
+    static constexpr std::size_t SlabSize = 64 * 1024;
+
+    //! Large blocks come from `upstream`
+    explicit RemoteFreePool(
+        MemoryStorage* upstream = boost::container::pmr::new_delete_resource());
+
+    //! Releases all slabs
+    ~RemoteFreePool();
+
+    RemoteFreePool(const RemoteFreePool&) = delete;
+    RemoteFreePool& operator=(const RemoteFreePool&) = delete;
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+
+    //! Any of these pools can free the blocks of any other
+    bool do_is_equal(const MemoryStorage& other) const noexcept override;
+
+private:
+    //! A free block, linked through its first bytes
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    //! Header at the start of every slab
+    struct Slab {
+        RemoteFreePool* owner;  //! who carved it
+        Slab* next;             //! all slabs of the owner
+    };
+
+    //! Index of the class serving `bytes`
+    static std::size_t sizeClass(std::size_t bytes) noexcept {
+        return bytes > 0 ? (bytes - 1) / Granularity : 0;
+    }
+
+    //! Cuts a new block of the class, allocating a slab if needed
+    void* carve(std::size_t cls);
+
+    //! Pushes the block on the return list of the class. Called by other threads
+    void pushRemote(std::size_t cls, void* ptr) noexcept;
+
+    MemoryStorage* _upstream;      //! large blocks
+    FreeBlock* _free[NumClasses];  //! free blocks per class
+    Slab* _slabs;                  //! all our slabs
+    char* _cursor;                 //! next block in the current slab
+    char* _end;                    //! end of the current slab
+
+    //! Keeps the return lists, written by other threads, off our cache lines
+    char _padding[64];
+
+    std::atomic<FreeBlock*> _remote[NumClasses];  //! blocks freed by other threads
+};
+
+}  // namespace hbthreads
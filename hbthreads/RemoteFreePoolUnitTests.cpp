@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "Channel.h"
+#include "Pointer.h"
+#include "RemoteFreePool.h"
+#include <set>
+#include <thread>
+#include <unistd.h>
+
+using namespace hbthreads;
+
+namespace {
+
+// Something to hand over between threads
+struct Payload : public Object {
+    Payload(int value) : value(value) {
+    }
+    int value;
+    char data[40];
+};
+
+}  // namespace
+
+TEST(RemoteFreePool, LocalReuse) {
+    RemoteFreePool pool;
+    void* a = pool.allocate(24);
+    void* b = pool.allocate(24);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(std::uintptr_t(a) % RemoteFreePool::Granularity, 0UL);
+
+    // Last in first out, within the same class
+    pool.deallocate(a, 24);
+    EXPECT_EQ(pool.allocate(20), a);
+
+    // Large blocks go upstream and come back fine
+    void* big = pool.allocate(RemoteFreePool::MaxSize + 1);
+    ASSERT_NE(big, nullptr);
+    pool.deallocate(big, RemoteFreePool::MaxSize + 1);
+
+    pool.deallocate(a, 20);
+    pool.deallocate(b, 24);
+    EXPECT_TRUE(pool.is_equal(pool));
+}
+
+TEST(RemoteFreePool, RemoteFreeGoesBackToOwner) {
+    RemoteFreePool owner;
+    void* ptr = owner.allocate(100);
+
+    // Freed through another thread's pool
+    std::thread other([ptr]() {
+        RemoteFreePool local;
+        local.deallocate(ptr, 100);
+        // Not ours, it is not reused here
+        void* mine = local.allocate(100);
+        EXPECT_NE(mine, ptr);
+        local.deallocate(mine, 100);
+    });
+    other.join();
+
+    // The owner picks it up once its own list is empty
+    EXPECT_EQ(owner.allocate(100), ptr);
+    owner.deallocate(ptr, 100);
+}
+
+TEST(RemoteFreePool, ObjectsCrossThreads) {
+    const int NUM_OBJECTS = 10000;
+    RemoteFreePool producer_pool;
+    storage = &producer_pool;
+
+    // The consumer releases what the producer allocates
+    SpscChannel<Payload*> channel(1024, false);
+    std::thread consumer([&channel]() {
+        RemoteFreePool consumer_pool;
+        storage = &consumer_pool;
+        int received = 0;
+        while (received < NUM_OBJECTS) {
+            received += channel.consume(
+                [](Payload* payload) { Pointer<Payload> release(payload); }, 64);
+            if (channel.empty()) usleep(10);
+        }
+        storage = nullptr;
+    });
+
+    std::set<Payload*> seen;
+    for (int j = 0; j < NUM_OBJECTS; ++j) {
+        Payload* payload = new Payload(j);
+        seen.insert(payload);
+        while (!channel.push(payload)) usleep(10);
+    }
+    consumer.join();
+
+    // Everything came back, so new objects reuse the same memory
+    for (int j = 0; j < 100; ++j) {
+        Pointer<Payload> payload(new Payload(j));
+        EXPECT_EQ(seen.count(payload.get()), 1UL);
+    }
+    storage = nullptr;
+}
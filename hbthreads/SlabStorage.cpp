@@ -0,0 +1,142 @@
+#include "SlabStorage.h"
+#include <sys/mman.h>
+#include <cstdint>
+#include <new>
+#include <stdio.h>
+
+using namespace hbthreads;
+
+// C++14 needs these defined somewhere in case they are bound to references
+constexpr std::size_t SlabStorage::Granularity;
+constexpr std::size_t SlabStorage::MaxSize;
+constexpr std::size_t SlabStorage::NumClasses;
+constexpr std::size_t SlabStorage::ArenaSize;
+
+SlabStorage::SlabStorage(bool hugepages, std::size_t arena_size, MemoryStorage* upstream)
+    : _upstream(upstream),
+      _arenas(nullptr),
+      _cursor(nullptr),
+      _end(nullptr),
+      _arena_size(((arena_size + ArenaSize - 1) / ArenaSize) * ArenaSize),
+      _mapped(0),
+      _huge_arenas(0),
+      _hugepages(hugepages) {
+    assert(upstream != nullptr && "Upstream storage must not be null");
+    assert(arena_size > 0 && "Arena size must not be zero");
+    static_assert(sizeof(Arena) % Granularity == 0, "Arena header breaks alignment");
+    for (std::size_t j = 0; j < NumClasses; ++j) {
+        _free[j] = nullptr;
+    }
+}
+
+SlabStorage::~SlabStorage() {
+    Arena* arena = _arenas;
+    while (arena != nullptr) {
+        Arena* next = arena->next;
+        ::munmap(arena, arena->size);
+        arena = next;
+    }
+}
+
+std::size_t SlabStorage::sizeClass(std::size_t bytes) noexcept {
+    if (bytes <= 4 * Granularity) {
+        return bytes > 0 ? (bytes - 1) / Granularity : 0;
+    }
+    // bytes is in (2^k, 2^(k+1)], split in four steps of 2^(k-2)
+    const std::size_t k = 63 - __builtin_clzl(bytes - 1);
+    const std::size_t step = (bytes - 1 - (std::size_t(1) << k)) >> (k - 2);
+    return 4 + 4 * (k - 6) + step;
+}
+
+std::size_t SlabStorage::classSize(std::size_t cls) noexcept {
+    if (cls < 4) return (cls + 1) * Granularity;
+    const std::size_t k = 6 + (cls - 4) / 4;
+    const std::size_t step = (cls - 4) % 4;
+    return (std::size_t(1) << k) + (step + 1) * (std::size_t(1) << (k - 2));
+}
+
+std::size_t SlabStorage::roundSize(std::size_t bytes) noexcept {
+    if (bytes > MaxSize) return 0;
+    return classSize(sizeClass(bytes));
+}
+
+void* SlabStorage::do_allocate(std::size_t bytes, std::size_t alignment) {
+    if ((bytes > MaxSize) || (alignment > Granularity)) {
+        return _upstream->allocate(bytes, alignment);
+    }
+    std::size_t cls = sizeClass(bytes);
+    FreeBlock* block = _free[cls];
+    if (block == nullptr) return carve(cls);
+    _free[cls] = block->next;
+    return block;
+}
+
+void SlabStorage::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) {
+    if ((bytes > MaxSize) || (alignment > Granularity)) {
+        _upstream->deallocate(ptr, bytes, alignment);
+        return;
+    }
+    std::size_t cls = sizeClass(bytes);
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = _free[cls];
+    _free[cls] = block;
+}
+
+bool SlabStorage::do_is_equal(const MemoryStorage& other) const noexcept {
+    return this == &other;
+}
+
+void* SlabStorage::carve(std::size_t cls) {
+    const std::size_t size = classSize(cls);
+    if (size > std::size_t(_end - _cursor)) {
+        // The tail of the current arena is lost, it is smaller than MaxSize
+        grow();
+    }
+    void* block = _cursor;
+    _cursor += size;
+    return block;
+}
+
+void SlabStorage::grow() {
+    void* ptr = MAP_FAILED;
+    if (_hugepages) {
+        // Only works if the admin reserved huge pages, fall back quietly
+        ptr = ::mmap(nullptr, _arena_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) _huge_arenas++;
+    }
+    if (ptr == MAP_FAILED) {
+        // Map one huge page more so we can trim the arena to a huge page boundary,
+        // transparent huge pages are only used for aligned ranges
+        const std::size_t size = _arena_size + ArenaSize;
+        void* raw = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (raw == MAP_FAILED) {
+            perror("SlabStorage::grow() on mmap");
+            throw std::bad_alloc();
+        }
+        std::uintptr_t start = std::uintptr_t(raw);
+        std::uintptr_t aligned = (start + ArenaSize - 1) & ~(ArenaSize - 1);
+        if (aligned > start) {
+            ::munmap(raw, aligned - start);
+        }
+        std::uintptr_t end = start + size;
+        if (end > aligned + _arena_size) {
+            ::munmap(reinterpret_cast<void*>(aligned + _arena_size),
+                     end - aligned - _arena_size);
+        }
+        ptr = reinterpret_cast<void*>(aligned);
+        if (_hugepages) {
+            // Just advice, it is fine if the kernel does not support it
+            ::madvise(ptr, _arena_size, MADV_HUGEPAGE);
+        }
+    }
+    _mapped += _arena_size;
+
+    Arena* arena = static_cast<Arena*>(ptr);
+    arena->next = _arenas;
+    arena->size = _arena_size;
+    _arenas = arena;
+    _cursor = static_cast<char*>(ptr) + sizeof(Arena);
+    _end = static_cast<char*>(ptr) + _arena_size;
+}
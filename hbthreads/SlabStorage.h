@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ImportedTypes.h"
+#include <boost/container/pmr/global_resource.hpp>
+#include <cstddef>
+
+namespace hbthreads {
+
+//! A size class allocator for the small blocks the library asks for: objects,
+//! flat containers and reactor tables.
+//! Classes are 16 bytes apart up to 64 bytes, then four per power of two at
+//! 1.25x, 1.5x, 1.75x and 2x of it, so at most 20% of a larger block is wasted.
+//! Freed blocks are threaded in a free list per class through their first bytes,
+//! so allocating and freeing are a list pop or push, or a bump of the arena
+//! cursor when the class list is empty - no headers, no searching.
+//! Blocks are carved from large arenas mapped straight from the system, which
+//! can be backed by huge pages to spare TLB misses. Memory only goes back to the
+//! system when the storage is destroyed. Larger or over aligned requests go to
+//! the upstream storage.
+//! Not thread safe - use one per thread like the `storage` itself.
+class SlabStorage : public MemoryStorage {
+public:
+    //! Distance between the smallest classes, also the alignment of all blocks
+    static constexpr std::size_t Granularity = 16;
+
+    //! Largest block served from the arenas
+    static constexpr std::size_t MaxSize = 32 * 1024;
+
+    //! Number of size classes
+    static constexpr std::size_t NumClasses = 40;
+
+    //! Default arena size, one huge page
+    static constexpr std::size_t ArenaSize = 2 * 1024 * 1024;
+
+    //! `hugepages` maps arenas with MAP_HUGETLB if the system has huge pages
+    //! reserved, or asks for transparent huge pages otherwise.
+    //! `arena_size` is rounded up to a multiple of ArenaSize.
+    explicit SlabStorage(
+        bool hugepages = false, std::size_t arena_size = ArenaSize,
+        MemoryStorage* upstream = boost::container::pmr::new_delete_resource());
+
+    //! Unmaps all arenas
+    ~SlabStorage();
+
+    SlabStorage(const SlabStorage&) = delete;
+    SlabStorage& operator=(const SlabStorage&) = delete;
+
+    //! Size of the block handed out for `bytes`, zero if it is not served here
+    static std::size_t roundSize(std::size_t bytes) noexcept;
+
+    //! Bytes mapped for arenas so far
+    std::size_t mapped() const noexcept {
+        return _mapped;
+    }
+
+    //! Number of arenas backed by MAP_HUGETLB pages
+    std::size_t hugeArenas() const noexcept {
+        return _huge_arenas;
+    }
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const MemoryStorage& other) const noexcept override;
+
+private:
+    //! A free block, linked through its first bytes
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    //! Header at the start of every arena
+    struct Arena {
+        Arena* next;       //! all arenas of the storage
+        std::size_t size;  //! bytes mapped
+    };
+
+    //! Index of the class serving `bytes`, which must be at most MaxSize
+    static std::size_t sizeClass(std::size_t bytes) noexcept;
+
+    //! Block size of the class
+    static std::size_t classSize(std::size_t cls) noexcept;
+
+    //! Cuts a new block of the class, mapping an arena if needed
+    void* carve(std::size_t cls);
+
+    //! Maps a new arena and makes it current
+    void grow();
+
+    MemoryStorage* _upstream;      //! large blocks
+    FreeBlock* _free[NumClasses];  //! free blocks per class
+    Arena* _arenas;                //! all our arenas
+    char* _cursor;                 //! next block in the current arena
+    char* _end;                    //! end of the current arena
+    std::size_t _arena_size;       //! bytes per arena
+    std::size_t _mapped;           //! bytes mapped
+    std::size_t _huge_arenas;      //! arenas on MAP_HUGETLB pages
+    bool _hugepages;               //! back arenas with huge pages
+};
+
+}  // namespace hbthreads
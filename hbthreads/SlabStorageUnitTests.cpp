@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "SlabStorage.h"
+#include <set>
+
+using namespace hbthreads;
+
+TEST(SlabStorage, SizeClasses) {
+    EXPECT_EQ(SlabStorage::roundSize(1), 16UL);
+    EXPECT_EQ(SlabStorage::roundSize(16), 16UL);
+    EXPECT_EQ(SlabStorage::roundSize(17), 32UL);
+    EXPECT_EQ(SlabStorage::roundSize(64), 64UL);
+    EXPECT_EQ(SlabStorage::roundSize(65), 80UL);
+    EXPECT_EQ(SlabStorage::roundSize(81), 96UL);
+    EXPECT_EQ(SlabStorage::roundSize(128), 128UL);
+    EXPECT_EQ(SlabStorage::roundSize(129), 160UL);
+    EXPECT_EQ(SlabStorage::roundSize(1000), 1024UL);
+    EXPECT_EQ(SlabStorage::roundSize(1025), 1280UL);
+    EXPECT_EQ(SlabStorage::roundSize(SlabStorage::MaxSize), SlabStorage::MaxSize);
+    EXPECT_EQ(SlabStorage::roundSize(SlabStorage::MaxSize + 1), 0UL);
+
+    // Every size fits its block, which is never more than 25% larger
+    for (std::size_t bytes = 65; bytes <= SlabStorage::MaxSize; ++bytes) {
+        std::size_t size = SlabStorage::roundSize(bytes);
+        ASSERT_GE(size, bytes);
+        ASSERT_LT(4 * (size - bytes), size) << bytes;
+        ASSERT_EQ(size % SlabStorage::Granularity, 0UL);
+    }
+}
+
+TEST(SlabStorage, Reuse) {
+    SlabStorage slabs;
+    EXPECT_EQ(slabs.mapped(), 0UL);
+    void* a = slabs.allocate(24);
+    void* b = slabs.allocate(24);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(std::uintptr_t(a) % SlabStorage::Granularity, 0UL);
+    EXPECT_EQ(slabs.mapped(), SlabStorage::ArenaSize);
+
+    // Last in first out, within the same class
+    slabs.deallocate(a, 24);
+    EXPECT_EQ(slabs.allocate(20), a);
+
+    // Large blocks go upstream and come back fine
+    void* big = slabs.allocate(SlabStorage::MaxSize + 1);
+    ASSERT_NE(big, nullptr);
+    slabs.deallocate(big, SlabStorage::MaxSize + 1);
+
+    slabs.deallocate(a, 20);
+    slabs.deallocate(b, 24);
+}
+
+TEST(SlabStorage, Arenas) {
+    // Fill more than one arena with blocks that do not overlap
+    SlabStorage slabs(true);
+    const std::size_t count = 2 * SlabStorage::ArenaSize / 1024;
+    std::set<char*> blocks;
+    for (std::size_t j = 0; j < count; ++j) {
+        char* ptr = static_cast<char*>(slabs.allocate(1000));
+        memset(ptr, 0xAB, 1000);
+        ASSERT_TRUE(blocks.insert(ptr).second);
+    }
+    EXPECT_EQ(slabs.mapped(), 3 * SlabStorage::ArenaSize);
+    char* last = nullptr;
+    for (char* ptr : blocks) {
+        if (last != nullptr) {
+            EXPECT_GE(ptr - last, 1024);
+        }
+        last = ptr;
+    }
+    for (char* ptr : blocks) {
+        slabs.deallocate(ptr, 1000);
+    }
+
+    // Everything is recycled, nothing new is mapped
+    for (std::size_t j = 0; j < count; ++j) {
+        EXPECT_EQ(blocks.count(static_cast<char*>(slabs.allocate(1000))), 1UL);
+    }
+    EXPECT_EQ(slabs.mapped(), 3 * SlabStorage::ArenaSize);
+}
+
+TEST(SlabStorage, Containers) {
+    SlabStorage slabs;
+    FlatSet<int> set(&slabs);
+    for (int j = 0; j < 10000; ++j) {
+        set.insert(j * 7 % 10000);
+    }
+    EXPECT_EQ(set.size(), 10000UL);
+    EXPECT_EQ(*set.begin(), 0);
+    EXPECT_EQ(*set.rbegin(), 9999);
+}
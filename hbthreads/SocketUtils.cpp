@@ -12,6 +12,8 @@
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 namespace hbthreads {
 
@@ -189,6 +191,16 @@ bool setSocketReceiveBufferSize(int sockfd, uint32_t bufsize) {
     return true;
 }
 
+bool setSocketBusyPoll(int sockid, int usecs) {
+    int res = setsockopt(sockid, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs));
+    if (res < 0) {
+        fprintf(stderr, "setSocketBusyPoll():setsockopt(SO_BUSY_POLL) error: %s\n",
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 uint32_t getSocketReceiveBufferSize(int sockfd) {
     int bufsize = 0;
     socklen_t optlen = sizeof(bufsize);
@@ -212,4 +224,88 @@ bool setSocketMulticastTTL(int sockid, int ttl) {
     return true;
 }
 
+bool setSocketZeroCopy(int sockid) {
+    int enable = 1;
+    int res = setsockopt(sockid, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable));
+    if (res < 0) {
+        fprintf(stderr, "setSocketZeroCopy(): setsockopt(SO_ZEROCOPY): %s\n",
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool setSocketTimestamps(int sockid) {
+    int enable = 1;
+    int res = setsockopt(sockid, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+    if (res < 0) {
+        fprintf(stderr, "setSocketTimestamps(): setsockopt(SO_TIMESTAMPNS): %s\n",
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool setSocketHardwareTimestamps(int sockid) {
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+                SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    int res = setsockopt(sockid, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    if (res < 0) {
+        fprintf(stderr,
+                "setSocketHardwareTimestamps(): setsockopt(SO_TIMESTAMPING): %s\n",
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static DateTime toDateTime(const timespec& ts) {
+    return DateTime::secs(ts.tv_sec) + DateTime::nsecs(ts.tv_nsec);
+}
+
+bool parseReceiveTimestamp(const msghdr* msg, DateTime* timestamp) {
+    // CMSG_NXTHDR() takes a non-const header although it does not modify it
+    msghdr* hdr = const_cast<msghdr*>(msg);
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            *timestamp = toDateTime(ts);
+            return true;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            // Software stamp first, then two legacy slots, the last is hardware
+            timespec ts[3];
+            memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+            bool hardware = (ts[2].tv_sec != 0) || (ts[2].tv_nsec != 0);
+            const timespec& best = hardware ? ts[2] : ts[0];
+            if ((best.tv_sec == 0) && (best.tv_nsec == 0)) continue;
+            *timestamp = toDateTime(best);
+            return true;
+        }
+    }
+    return false;
+}
+
+ssize_t receiveWithTimestamp(int sockid, void* buffer, std::size_t size,
+                             DateTime* timestamp) {
+    iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    alignas(cmsghdr) char control[TimestampControlSize];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t nb = ::recvmsg(sockid, &msg, MSG_DONTWAIT);
+    if ((nb >= 0) && !parseReceiveTimestamp(&msg, timestamp)) {
+        *timestamp = DateTime::zero();
+    }
+    return nb;
+}
+
 }  // namespace hbthreads
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "DateTime.h"
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
 
 namespace hbthreads {
 
@@ -39,8 +42,43 @@ bool setSocketReceiveBufferSize(int sockfd, uint32_t bufsize);
 //! Retrieves the socket buffer size
 uint32_t getSocketReceiveBufferSize(int sockfd);
 
+//! Enables kernel busy polling on the socket for blocking reads
+//! The kernel will poll the device queue for up to `usecs` microseconds before
+//! sleeping. Raising it above net.core.busy_read requires CAP_NET_ADMIN
+bool setSocketBusyPoll(int sockid, int usecs);
+
 //! Sets the maximum number of hops messages could go
 //! Affects only outgoing multicast packets
 bool setSocketMulticastTTL(int sockid, int ttl);
 
+//! Allows sends with MSG_ZEROCOPY on this socket (SO_ZEROCOPY), see ZeroCopySender
+bool setSocketZeroCopy(int sockid);
+
+//! Asks the kernel to stamp received packets with the time they were queued
+//! on the socket (SO_TIMESTAMPNS). Works on UDP and TCP, including loopback.
+//! The kernel turns stamping on a little after the first socket asks for it,
+//! until then packets carry the time they were read instead
+bool setSocketTimestamps(int sockid);
+
+//! Asks for NIC hardware receive timestamps with software as fallback
+//! (SO_TIMESTAMPING). The interface must have hardware stamping enabled
+//! through SIOCSHWTSTAMP, otherwise only software stamps are reported.
+//! The first packets after enabling it can come without any stamp
+bool setSocketHardwareTimestamps(int sockid);
+
+//! Room for the control messages carrying one receive timestamp of either kind
+constexpr std::size_t TimestampControlSize =
+    CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(3 * sizeof(timespec));
+
+//! Extracts the receive timestamp from the control messages of recvmsg().
+//! Hardware stamps win over software ones. Returns false if there is none
+bool parseReceiveTimestamp(const msghdr* msg, DateTime* timestamp);
+
+//! Reads like recv() with MSG_DONTWAIT and also returns the receive
+//! timestamp, zero if the socket does not have timestamps enabled.
+//! Right after enabling them the first packets can carry the time they were
+//! read instead, or no stamp at all (zero)
+ssize_t receiveWithTimestamp(int sockid, void* buffer, std::size_t size,
+                             DateTime* timestamp);
+
 }  // namespace hbthreads
\ No newline at end of file
@@ -88,4 +88,53 @@ TEST(SocketUtils, createAndBindUDPSocket) {
     EXPECT_EQ(19999, ntohs(sin.sin_port));
 
     ::close(fd);
-}
\ No newline at end of file
+}
+
+TEST(SocketUtils, receiveWithTimestamp) {
+    int rxfd = createUDPSocket();
+    int txfd = createUDPSocket();
+    ASSERT_GE(rxfd, 0);
+    ASSERT_GE(txfd, 0);
+    ASSERT_TRUE(bindSocket(rxfd, "127.0.0.1", 0));
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    ASSERT_EQ(0, getsockname(rxfd, (struct sockaddr *)&sin, &len));
+
+    // Without timestamps enabled we get a zero stamp
+    char buf[16];
+    DateTime stamp = DateTime::secs(1);
+    ASSERT_EQ(1, sendto(txfd, "a", 1, 0, (struct sockaddr *)&sin, sizeof(sin)));
+    EXPECT_EQ(1, receiveWithTimestamp(rxfd, buf, sizeof(buf), &stamp));
+    EXPECT_EQ(stamp, DateTime::zero());
+
+    // Nothing pending does not block
+    EXPECT_LT(receiveWithTimestamp(rxfd, buf, sizeof(buf), &stamp), 0);
+
+    // Loopback packets get software stamps. The kernel turns stamping on a
+    // bit later, so the first packet is only there to warm it up
+    EXPECT_TRUE(setSocketTimestamps(rxfd));
+    ASSERT_EQ(1, sendto(txfd, "w", 1, 0, (struct sockaddr *)&sin, sizeof(sin)));
+    EXPECT_EQ(1, receiveWithTimestamp(rxfd, buf, sizeof(buf), &stamp));
+    DateTime before = DateTime::now();
+    ASSERT_EQ(1, sendto(txfd, "b", 1, 0, (struct sockaddr *)&sin, sizeof(sin)));
+    EXPECT_EQ(1, receiveWithTimestamp(rxfd, buf, sizeof(buf), &stamp));
+    EXPECT_GE(stamp, before);
+
+    // Asking for hardware stamps falls back to software ones
+    int fd = createUDPSocket();
+    ASSERT_GE(fd, 0);
+    ASSERT_TRUE(bindSocket(fd, "127.0.0.1", 0));
+    len = sizeof(sin);
+    ASSERT_EQ(0, getsockname(fd, (struct sockaddr *)&sin, &len));
+    EXPECT_TRUE(setSocketHardwareTimestamps(fd));
+    ASSERT_EQ(1, sendto(txfd, "w", 1, 0, (struct sockaddr *)&sin, sizeof(sin)));
+    EXPECT_EQ(1, receiveWithTimestamp(fd, buf, sizeof(buf), &stamp));
+    before = DateTime::now();
+    ASSERT_EQ(1, sendto(txfd, "c", 1, 0, (struct sockaddr *)&sin, sizeof(sin)));
+    EXPECT_EQ(1, receiveWithTimestamp(fd, buf, sizeof(buf), &stamp));
+    EXPECT_GE(stamp, before);
+
+    ::close(fd);
+    ::close(rxfd);
+    ::close(txfd);
+}
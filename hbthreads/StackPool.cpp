@@ -0,0 +1,141 @@
+#include "StackPool.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdint>
+#include <new>
+#include <stdio.h>
+
+using namespace hbthreads;
+
+namespace hbthreads {
+__thread StackPool* stack_pool = nullptr;
+}
+
+// C++14 needs these defined somewhere in case they are bound to references
+constexpr std::size_t StackPool::MinStackSize;
+constexpr std::size_t StackPool::NumClasses;
+constexpr std::size_t StackPool::MaxStackSize;
+constexpr std::size_t StackPool::GrowCount;
+constexpr std::size_t StackPool::HugePageSize;
+
+StackPool::StackPool(bool hugepages) : _chunks(nullptr), _hugepages(hugepages) {
+    for (std::size_t j = 0; j < NumClasses; ++j) {
+        _free[j] = nullptr;
+        _available[j] = 0;
+    }
+}
+
+StackPool::~StackPool() {
+    Chunk* chunk = _chunks;
+    while (chunk != nullptr) {
+        Chunk* next = chunk->next;
+        ::munmap(chunk, chunk->size);
+        chunk = next;
+    }
+}
+
+std::size_t StackPool::sizeClass(std::size_t stack_size) noexcept {
+    std::size_t cls = 0;
+    while ((cls + 1 < NumClasses) && ((MinStackSize << cls) < stack_size)) {
+        cls++;
+    }
+    return cls;
+}
+
+std::size_t StackPool::roundSize(std::size_t stack_size) noexcept {
+    return MinStackSize << sizeClass(stack_size);
+}
+
+bool StackPool::grow(std::size_t cls, std::size_t count) {
+    // Layout is [header page] then [guard page][stack] for every stack.
+    // Stacks that can use huge pages are aligned to them instead, so the header
+    // and the guards get padded to a whole huge page
+    const std::size_t page = ::sysconf(_SC_PAGESIZE);
+    const std::size_t stack_size = MinStackSize << cls;
+    const bool huge = _hugepages && (stack_size % HugePageSize == 0);
+    const std::size_t align = huge ? HugePageSize : page;
+    const std::size_t slot = align + stack_size;
+    std::size_t size = align + count * slot;
+    // Map one huge page more so we can trim the start to a huge page boundary
+    const std::size_t mapped = huge ? size + HugePageSize : size;
+    void* ptr = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        perror("StackPool::grow() on mmap");
+        return false;
+    }
+    if (huge) {
+        std::uintptr_t start = std::uintptr_t(ptr);
+        std::uintptr_t aligned = (start + HugePageSize - 1) & ~(HugePageSize - 1);
+        if (aligned > start) {
+            ::munmap(ptr, aligned - start);
+        }
+        std::uintptr_t end = start + mapped;
+        if (end > aligned + size) {
+            ::munmap(reinterpret_cast<void*>(aligned + size), end - aligned - size);
+        }
+        ptr = reinterpret_cast<void*>(aligned);
+    }
+
+    Chunk* chunk = static_cast<Chunk*>(ptr);
+    chunk->next = _chunks;
+    chunk->size = size;
+    _chunks = chunk;
+
+    // Protect the guards and thread the stacks in the free list
+    char* base = static_cast<char*>(ptr) + align;
+    for (std::size_t j = 0; j < count; ++j) {
+        char* stack_base = base + j * slot + align;
+        if (::mprotect(stack_base - page, page, PROT_NONE) != 0) {
+            perror("StackPool::grow() on mprotect");
+        }
+        if (huge) {
+            // Just advice, it is fine if the kernel does not support it
+            ::madvise(stack_base, stack_size, MADV_HUGEPAGE);
+        }
+        FreeStack* stack = reinterpret_cast<FreeStack*>(stack_base + stack_size) - 1;
+        stack->next = _free[cls];
+        _free[cls] = stack;
+    }
+    _available[cls] += count;
+    return true;
+}
+
+bool StackPool::reserve(std::size_t stack_size, std::size_t count) {
+    assert(stack_size <= MaxStackSize && "Stack size too large for the pool");
+    std::size_t cls = sizeClass(stack_size);
+    if (_available[cls] >= count) return true;
+    return grow(cls, count - _available[cls]);
+}
+
+stack_context StackPool::allocate(std::size_t stack_size) {
+    assert(stack_size <= MaxStackSize && "Stack size too large for the pool");
+    std::size_t cls = sizeClass(stack_size);
+    if ((_free[cls] == nullptr) && !grow(cls, GrowCount)) {
+        throw std::bad_alloc();
+    }
+    FreeStack* stack = _free[cls];
+    _free[cls] = stack->next;
+    _available[cls] -= 1;
+
+    // The stack grows down from just above the free list node
+    stack_context sctx;
+    sctx.size = MinStackSize << cls;
+    sctx.sp = stack + 1;
+    return sctx;
+}
+
+void StackPool::deallocate(stack_context& sctx) noexcept {
+    assert(sctx.sp != nullptr && "Stack was not allocated");
+    std::size_t cls = sizeClass(sctx.size);
+    FreeStack* stack = static_cast<FreeStack*>(sctx.sp) - 1;
+    stack->next = _free[cls];
+    _free[cls] = stack;
+    _available[cls] += 1;
+    sctx.sp = nullptr;
+    sctx.size = 0;
+}
+
+std::size_t StackPool::available(std::size_t stack_size) const noexcept {
+    return _available[sizeClass(stack_size)];
+}
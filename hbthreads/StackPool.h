@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ImportedTypes.h"
+#include <cstddef>
+
+namespace hbthreads {
+
+//! A pool of coroutine stacks grouped in power of two size classes.
+//! Stacks are carved out of large mappings with a guard page below each one, so
+//! getting and returning a stack is a free list pop/push instead of the
+//! mmap/mprotect/munmap round trip of StackAllocator.
+//! Memory only goes back to the system when the pool is destroyed, which must
+//! happen after all threads using it are gone. Not thread safe - use one pool
+//! per thread like the memory storage.
+class StackPool {
+public:
+    //! Size of the smallest class. Requests are rounded up to a power of two
+    static constexpr std::size_t MinStackSize = 4 * 1024;
+
+    //! Number of size classes, from 4kB to 8MB
+    static constexpr std::size_t NumClasses = 12;
+
+    //! Size of the largest class
+    static constexpr std::size_t MaxStackSize = MinStackSize << (NumClasses - 1);
+
+    //! Stacks are mapped in groups of this many when a class runs dry
+    static constexpr std::size_t GrowCount = 16;
+
+    //! Huge pages only back ranges aligned to this size
+    static constexpr std::size_t HugePageSize = 2 * 1024 * 1024;
+
+    //! hugepages asks the kernel to back stacks with transparent huge pages.
+    //! Only classes of whole huge pages benefit: their stacks are aligned to
+    //! HugePageSize, with the guard page at the end of the padding below them.
+    //! The padding is address space only, it is never touched.
+    StackPool(bool hugepages = false);
+
+    //! Unmaps everything - all stacks must have been returned
+    ~StackPool();
+
+    StackPool(const StackPool&) = delete;
+    StackPool& operator=(const StackPool&) = delete;
+
+    //! Preallocates so there are at least `count` free stacks able to hold
+    //! `stack_size` bytes. Returns false if the memory could not be mapped
+    bool reserve(std::size_t stack_size, std::size_t count);
+
+    //! Returns a stack with at least `stack_size` usable bytes
+    //! Throws std::bad_alloc if there is no memory, like StackAllocator
+    stack_context allocate(std::size_t stack_size);
+
+    //! Puts the stack back in its free list
+    void deallocate(stack_context& sctx) noexcept;
+
+    //! Number of free stacks in the class serving `stack_size`
+    std::size_t available(std::size_t stack_size) const noexcept;
+
+    //! Usable size of the stacks returned for `stack_size`
+    static std::size_t roundSize(std::size_t stack_size) noexcept;
+
+private:
+    //! Index of the class serving `stack_size`
+    static std::size_t sizeClass(std::size_t stack_size) noexcept;
+
+    //! Maps `count` more stacks of the given class
+    bool grow(std::size_t cls, std::size_t count);
+
+    //! A free stack, stored at the top of the stack itself
+    struct FreeStack {
+        FreeStack* next;
+    };
+
+    //! One mapping. The header lives in its first page
+    struct Chunk {
+        Chunk* next;       //! next mapping
+        std::size_t size;  //! total size of the mapping
+    };
+
+    FreeStack* _free[NumClasses];        //! free stacks per class
+    std::size_t _available[NumClasses];  //! number of free stacks per class
+    Chunk* _chunks;                      //! all mappings
+    bool _hugepages;                     //! advise huge pages on new mappings
+};
+
+//! Pool used by `LightThread::start()` in this thread, if any
+extern __thread StackPool* stack_pool;
+
+}  // namespace hbthreads
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include "StackPool.h"
+#include "LightThread.h"
+#include <cstring>
+
+using namespace hbthreads;
+
+namespace {
+
+// Touches a good chunk of its stack then waits forever
+class DeepThread : public LightThread {
+public:
+    int finished = 0;
+
+    void run() override {
+        char buffer[8 * 1024];
+        memset(buffer, 1, sizeof(buffer));
+        asm volatile("" : : "r"(buffer) : "memory");
+        finished = 1;
+        while (true) {
+            wait();
+        }
+    }
+};
+
+}  // namespace
+
+class StackPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+    }
+
+    void TearDown() override {
+        stack_pool = nullptr;
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+};
+
+TEST_F(StackPoolTest, SizeClasses) {
+    EXPECT_EQ(StackPool::roundSize(1), 4 * 1024UL);
+    EXPECT_EQ(StackPool::roundSize(4 * 1024), 4 * 1024UL);
+    EXPECT_EQ(StackPool::roundSize(4 * 1024 + 1), 8 * 1024UL);
+    EXPECT_EQ(StackPool::roundSize(100 * 1024), 128 * 1024UL);
+    EXPECT_EQ(StackPool::roundSize(StackPool::MaxStackSize), StackPool::MaxStackSize);
+}
+
+TEST_F(StackPoolTest, Reserve) {
+    StackPool stacks;
+    EXPECT_EQ(stacks.available(16 * 1024), 0UL);
+    EXPECT_TRUE(stacks.reserve(16 * 1024, 10));
+    EXPECT_EQ(stacks.available(16 * 1024), 10UL);
+    EXPECT_EQ(stacks.available(32 * 1024), 0UL);
+
+    // Reserving less than what is free does nothing
+    EXPECT_TRUE(stacks.reserve(16 * 1024, 5));
+    EXPECT_EQ(stacks.available(16 * 1024), 10UL);
+}
+
+TEST_F(StackPoolTest, AllocateReusesStacks) {
+    StackPool stacks;
+    ASSERT_TRUE(stacks.reserve(16 * 1024, 1));
+
+    stack_context sctx = stacks.allocate(10 * 1024);
+    EXPECT_EQ(sctx.size, 16 * 1024UL);
+    ASSERT_NE(sctx.sp, nullptr);
+    EXPECT_EQ(stacks.available(16 * 1024), 0UL);
+    void* sp = sctx.sp;
+
+    // The whole stack is writable
+    memset(static_cast<char*>(sctx.sp) - sctx.size, 0, sctx.size);
+
+    stacks.deallocate(sctx);
+    EXPECT_EQ(stacks.available(16 * 1024), 1UL);
+
+    // The same stack comes back
+    sctx = stacks.allocate(16 * 1024);
+    EXPECT_EQ(sctx.sp, sp);
+    stacks.deallocate(sctx);
+}
+
+TEST_F(StackPoolTest, GrowsWhenEmpty) {
+    StackPool stacks;
+    std::vector<stack_context> contexts;
+    for (std::size_t j = 0; j < StackPool::GrowCount + 1; ++j) {
+        contexts.push_back(stacks.allocate(4 * 1024));
+    }
+    EXPECT_EQ(stacks.available(4 * 1024), StackPool::GrowCount - 1);
+    for (stack_context& sctx : contexts) {
+        stacks.deallocate(sctx);
+    }
+    EXPECT_EQ(stacks.available(4 * 1024), 2 * StackPool::GrowCount);
+}
+
+TEST_F(StackPoolTest, HugePageStacksAreAligned) {
+    StackPool stacks(true);
+    std::vector<stack_context> contexts;
+    for (int j = 0; j < 2; ++j) {
+        contexts.push_back(stacks.allocate(StackPool::HugePageSize));
+    }
+    for (stack_context& sctx : contexts) {
+        EXPECT_EQ(sctx.size, StackPool::HugePageSize);
+        char* bottom = static_cast<char*>(sctx.sp) - sctx.size;
+        EXPECT_EQ(std::uintptr_t(bottom) % StackPool::HugePageSize, 0UL);
+        memset(bottom, 0, sctx.size);
+    }
+    for (stack_context& sctx : contexts) {
+        stacks.deallocate(sctx);
+    }
+
+    // Smaller classes keep the compact layout
+    stack_context sctx = stacks.allocate(16 * 1024);
+    memset(static_cast<char*>(sctx.sp) - sctx.size, 0, sctx.size);
+    stacks.deallocate(sctx);
+}
+
+TEST_F(StackPoolTest, GuardPage) {
+    StackPool stacks;
+    stack_context sctx = stacks.allocate(4 * 1024);
+    // Writing just below the stack must crash
+    volatile char* bottom = static_cast<char*>(sctx.sp) - sctx.size;
+    ASSERT_DEATH({ bottom[-1] = 0; }, "");
+    stacks.deallocate(sctx);
+}
+
+TEST_F(StackPoolTest, ThreadsUsePool) {
+    StackPool stacks;
+    stack_pool = &stacks;
+    ASSERT_TRUE(stacks.reserve(16 * 1024, 4));
+    {
+        Pointer<DeepThread> thread1(new DeepThread);
+        Pointer<DeepThread> thread2(new DeepThread);
+        thread1->start(16 * 1024);
+        thread2->start(16 * 1024);
+        EXPECT_EQ(thread1->finished, 1);
+        EXPECT_EQ(thread2->finished, 1);
+        EXPECT_EQ(stacks.available(16 * 1024), 2UL);
+    }
+    // Destroyed threads return their stacks
+    EXPECT_EQ(stacks.available(16 * 1024), 4UL);
+}
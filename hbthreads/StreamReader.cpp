@@ -0,0 +1,161 @@
+#include "StreamReader.h"
+#include "LightThread.h"
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace hbthreads;
+
+StreamReader::StreamReader(MemoryStorage* mem, int fd, std::size_t capacity)
+    : _fd(fd),
+      _buffer(mem),
+      _head(0),
+      _tail(0),
+      _scanned(0),
+      _prefix(4),
+      _max_size(16 * 1024 * 1024),
+      _timeout(DateTime::zero()),
+      _reads(0),
+      _status(StreamStatus::Ok) {
+    assert(mem != nullptr && "MemoryStorage must not be null");
+    assert(capacity > 0 && "Capacity must not be zero");
+    _buffer.resize(capacity);
+}
+
+void StreamReader::setPrefixSize(std::size_t bytes) {
+    assert(((bytes == 1) || (bytes == 2) || (bytes == 4) || (bytes == 8)) &&
+           "Invalid prefix size");
+    _prefix = bytes;
+}
+
+ByteSpan StreamReader::readExact(std::size_t size) {
+    if (size > _max_size) {
+        _status = StreamStatus::TooLarge;
+        return ByteSpan();
+    }
+    if (!fill(size)) return ByteSpan();
+    return take(size);
+}
+
+ByteSpan StreamReader::readFrame() {
+    if (!fill(_prefix)) return ByteSpan();
+    std::uint64_t length = 0;
+    const unsigned char* bytes =
+        reinterpret_cast<const unsigned char*>(_buffer.data() + _head);
+    for (std::size_t j = 0; j < _prefix; ++j) {
+        length = (length << 8) | bytes[j];
+    }
+    if (length > _max_size) {
+        _status = StreamStatus::TooLarge;
+        return ByteSpan();
+    }
+    // The prefix stays in the buffer until the whole frame is there
+    if (!fill(_prefix + length)) return ByteSpan();
+    take(_prefix);
+    return take(length);
+}
+
+ByteSpan StreamReader::readUntil(char delimiter) {
+    while (true) {
+        // Only look at the bytes we have not looked at before
+        const char* start = _buffer.data() + _head;
+        const void* found = ::memchr(start + _scanned, delimiter, available() - _scanned);
+        if (found != nullptr) {
+            std::size_t size = static_cast<const char*>(found) - start;
+            ByteSpan span = take(size + 1);
+            span.size = size;
+            return span;
+        }
+        _scanned = available();
+        if (_scanned >= _max_size) {
+            _status = StreamStatus::TooLarge;
+            return ByteSpan();
+        }
+        if (!fill(_scanned + 1)) return ByteSpan();
+    }
+}
+
+ByteSpan StreamReader::take(std::size_t size) noexcept {
+    ByteSpan span;
+    span.data = _buffer.data() + _head;
+    span.size = size;
+    _head += size;
+    _scanned = 0;
+    _status = StreamStatus::Ok;
+    return span;
+}
+
+bool StreamReader::fill(std::size_t size) {
+    while (available() < size) {
+        reserve(size);
+        // Ask for all the room we have, not just what is missing
+        ssize_t nb =
+            ::recv(_fd, _buffer.data() + _tail, _buffer.size() - _tail, MSG_DONTWAIT);
+        _reads++;
+        if (nb > 0) {
+            _tail += nb;
+            continue;
+        }
+        if (nb == 0) {
+            _status = StreamStatus::Closed;
+            return false;
+        }
+        if (errno == EINTR) continue;
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            _status = StreamStatus::Error;
+            return false;
+        }
+        if (!await()) return false;
+    }
+    return true;
+}
+
+void StreamReader::reserve(std::size_t size) {
+    // Nothing left to keep, start over at the front
+    if (_head == _tail) {
+        _head = 0;
+        _tail = 0;
+    }
+    if ((_head + size <= _buffer.size()) && (_tail < _buffer.size())) return;
+
+    // Slide the unread bytes to the front, growing if they would still not fit
+    std::size_t used = available();
+    if ((size > _buffer.size()) || (used == _buffer.size())) {
+        std::size_t capacity = 2 * _buffer.size();
+        _buffer.resize(capacity > size ? capacity : size);
+    }
+    ::memmove(_buffer.data(), _buffer.data() + _head, used);
+    _head = 0;
+    _tail = used;
+}
+
+bool StreamReader::await() {
+    LightThread* self = LightThread::current();
+    assert(self != nullptr && "Only light threads can wait for data");
+    while (true) {
+        EventType type = EventType::NA;
+        if (_timeout.nsecs() > 0) {
+            type = self->waitFd(_fd, _timeout);
+        } else {
+            // Look into all events in case the reactor batches them
+            for (const Event& ev : *self->wait()) {
+                if ((ev.type != EventType::Timeout) && (ev.type != EventType::Wakeup) &&
+                    (ev.fd == _fd)) {
+                    type = ev.type;
+                    break;
+                }
+            }
+        }
+        switch (type) {
+            // recv() tells a hangup from data
+            case EventType::SocketRead:
+            case EventType::SocketHangup: return true;
+            case EventType::SocketError: _status = StreamStatus::Error; return false;
+            case EventType::Timeout: _status = StreamStatus::Timeout; return false;
+            case EventType::SocketWriteable:
+            case EventType::ErrorQueue:
+            case EventType::Wakeup:
+            case EventType::NA: break;
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "DateTime.h"
+#include "ImportedTypes.h"
+#include <cstddef>
+
+namespace hbthreads {
+
+//! A run of bytes inside a StreamReader buffer. Null if nothing was read
+struct ByteSpan {
+    const char* data = nullptr;  //! first byte
+    std::size_t size = 0;        //! number of bytes
+
+    //! Returns true if there is data
+    explicit operator bool() const noexcept {
+        return data != nullptr;
+    }
+};
+
+//! Why a StreamReader stopped returning data
+enum class StreamStatus : std::uint8_t {
+    Ok = 0,        //! all good
+    Closed = 1,    //! the peer closed the stream
+    Error = 2,     //! the socket failed, see errno
+    Timeout = 3,   //! no data within the timeout
+    TooLarge = 4   //! a frame is larger than the maximum size
+};
+
+//! Cuts a byte stream into messages for a light thread.
+//! Each `read*()` call returns the next message, suspending the calling thread
+//! in `wait()` only while the buffer does not hold enough data. Reads take as
+//! much as the socket has, so one syscall usually serves many messages.
+//! The returned spans point into the buffer and are valid until the next call.
+//! The buffer comes from the memory storage and keeps messages contiguous:
+//! unread bytes slide to the front when the end is reached and it doubles when
+//! a message does not fit, up to `maxSize()`.
+//! The calling thread must be subscribed to the socket. While it waits, events
+//! of other sockets are dropped - level triggered subscriptions report them
+//! again. Not thread safe.
+class StreamReader {
+public:
+    //! Reads from `fd`, which should be a stream socket, with an initial buffer
+    //! of `capacity` bytes
+    StreamReader(MemoryStorage* mem, int fd, std::size_t capacity = 64 * 1024);
+
+    StreamReader(const StreamReader&) = delete;
+    StreamReader& operator=(const StreamReader&) = delete;
+
+    //! Returns the next `size` bytes
+    ByteSpan readExact(std::size_t size);
+
+    //! Returns the payload of the next length prefixed frame, see `setPrefixSize()`
+    ByteSpan readFrame();
+
+    //! Returns the bytes up to the next `delimiter`, which is consumed but not
+    //! included
+    ByteSpan readUntil(char delimiter);
+
+    //! Length prefixes are unsigned big endian (network order) integers of 1, 2, 4
+    //! or 8 bytes, 4 by default. They do not count themselves
+    void setPrefixSize(std::size_t bytes);
+
+    //! Gives up waiting after `timeout`, zero (the default) waits forever
+    void setTimeout(DateTime timeout) noexcept {
+        _timeout = timeout;
+    }
+
+    //! Largest message accepted, 16MB by default
+    void setMaxSize(std::size_t size) noexcept {
+        _max_size = size;
+    }
+    std::size_t maxSize() const noexcept {
+        return _max_size;
+    }
+
+    //! Why the last call returned nothing
+    StreamStatus status() const noexcept {
+        return _status;
+    }
+
+    //! Number of bytes received and not returned yet
+    std::size_t available() const noexcept {
+        return _tail - _head;
+    }
+
+    //! Number of recv() calls so far
+    std::uint64_t reads() const noexcept {
+        return _reads;
+    }
+
+    //! The socket
+    int fd() const noexcept {
+        return _fd;
+    }
+
+private:
+    //! Receives until there are at least `size` unread bytes
+    bool fill(std::size_t size);
+
+    //! Makes room after the unread bytes so they can become `size` long
+    void reserve(std::size_t size);
+
+    //! Suspends until the socket is readable. Returns false if it never will be
+    bool await();
+
+    //! Returns the next `size` unread bytes and consumes them
+    ByteSpan take(std::size_t size) noexcept;
+
+    int _fd;                 //! the socket
+    Vector<char> _buffer;    //! the unread bytes are in [_head, _tail)
+    std::size_t _head;       //! first unread byte
+    std::size_t _tail;       //! end of the received bytes
+    std::size_t _scanned;    //! unread bytes known not to hold the delimiter
+    std::size_t _prefix;     //! length prefix size
+    std::size_t _max_size;   //! largest message
+    DateTime _timeout;       //! how long to wait for data, zero is forever
+    std::uint64_t _reads;    //! recv() calls
+    StreamStatus _status;    //! what happened last
+};
+
+}  // namespace hbthreads
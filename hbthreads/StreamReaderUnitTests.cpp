@@ -0,0 +1,203 @@
+#include <gtest/gtest.h>
+#include "EpollReactor.h"
+#include "StreamReader.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace hbthreads;
+
+namespace {
+
+// Runs a function over the reader and records what comes out
+class ReaderThread : public LightThread {
+public:
+    ReaderThread(StreamReader* reader, std::function<ByteSpan(StreamReader&)> read)
+        : reader(reader), read(read) {
+    }
+    StreamReader* reader;
+    std::function<ByteSpan(StreamReader&)> read;
+    std::vector<std::string> messages;
+    StreamStatus status = StreamStatus::Ok;
+
+    void run() override {
+        while (true) {
+            ByteSpan span = read(*reader);
+            if (!span) break;
+            messages.emplace_back(span.data, span.size);
+        }
+        status = reader->status();
+    }
+};
+
+// Appends a frame with a 4 byte big endian prefix
+void appendFrame(std::string& out, const std::string& payload) {
+    std::uint32_t length = htonl(payload.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(payload);
+}
+
+}  // namespace
+
+class StreamReaderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+        ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    }
+
+    void TearDown() override {
+        if (fds[0] >= 0) ::close(fds[0]);
+        if (fds[1] >= 0) ::close(fds[1]);
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    // Starts a reader thread on the read end of the pair
+    Pointer<ReaderThread> startReader(Reactor& reactor, StreamReader& reader,
+                                      std::function<ByteSpan(StreamReader&)> read) {
+        Pointer<ReaderThread> thread(new ReaderThread(&reader, read));
+        reactor.monitor(fds[0], thread.get());
+        thread->start(32 * 1024);
+        return thread;
+    }
+
+    void send(const std::string& data) {
+        ASSERT_EQ(ssize_t(data.size()), ::write(fds[1], data.data(), data.size()));
+    }
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+    int fds[2];
+};
+
+TEST_F(StreamReaderTest, ManyFramesOneRead) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    StreamReader reader(buffer, fds[0]);
+    Pointer<ReaderThread> thread =
+        startReader(reactor, reader, [](StreamReader& r) { return r.readFrame(); });
+
+    // Nothing there yet, the first attempt suspends
+    EXPECT_EQ(reader.reads(), 1UL);
+    EXPECT_TRUE(thread->messages.empty());
+
+    std::string data;
+    for (int j = 0; j < 100; ++j) {
+        appendFrame(data, "message " + std::to_string(j));
+    }
+    appendFrame(data, "");
+    send(data);
+    reactor.work();
+
+    ASSERT_EQ(thread->messages.size(), 101UL);
+    EXPECT_EQ(thread->messages[0], "message 0");
+    EXPECT_EQ(thread->messages[99], "message 99");
+    EXPECT_EQ(thread->messages[100], "");
+    // One read got everything, the next one found the socket empty
+    EXPECT_EQ(reader.reads(), 3UL);
+    EXPECT_EQ(reader.available(), 0UL);
+}
+
+TEST_F(StreamReaderTest, PartialFrames) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    StreamReader reader(buffer, fds[0], 16);
+    Pointer<ReaderThread> thread =
+        startReader(reactor, reader, [](StreamReader& r) { return r.readFrame(); });
+
+    // Byte by byte, and larger than the initial buffer
+    std::string payload(100, 'x');
+    std::string data;
+    appendFrame(data, payload);
+    appendFrame(data, "tail");
+    for (char c : data) {
+        send(std::string(1, c));
+        reactor.work();
+    }
+    ASSERT_EQ(thread->messages.size(), 2UL);
+    EXPECT_EQ(thread->messages[0], payload);
+    EXPECT_EQ(thread->messages[1], "tail");
+
+    // Closing ends the loop
+    ::close(fds[1]);
+    fds[1] = -1;
+    reactor.work();
+    EXPECT_TRUE(thread->finished());
+    EXPECT_EQ(thread->status, StreamStatus::Closed);
+}
+
+TEST_F(StreamReaderTest, ReadUntil) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    StreamReader reader(buffer, fds[0], 8);
+    Pointer<ReaderThread> thread =
+        startReader(reactor, reader, [](StreamReader& r) { return r.readUntil('\n'); });
+
+    send("first line\nsecond");
+    reactor.work();
+    ASSERT_EQ(thread->messages.size(), 1UL);
+    EXPECT_EQ(thread->messages[0], "first line");
+
+    send(" line\n\nthird line is long enough to grow the buffer\n");
+    reactor.work();
+    ASSERT_EQ(thread->messages.size(), 4UL);
+    EXPECT_EQ(thread->messages[1], "second line");
+    EXPECT_EQ(thread->messages[2], "");
+    EXPECT_EQ(thread->messages[3], "third line is long enough to grow the buffer");
+}
+
+TEST_F(StreamReaderTest, ReadExact) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    StreamReader reader(buffer, fds[0], 4);
+    Pointer<ReaderThread> thread =
+        startReader(reactor, reader, [](StreamReader& r) { return r.readExact(3); });
+
+    send("abcdefg");
+    reactor.work();
+    ASSERT_EQ(thread->messages.size(), 2UL);
+    EXPECT_EQ(thread->messages[0], "abc");
+    EXPECT_EQ(thread->messages[1], "def");
+    EXPECT_EQ(reader.available(), 1UL);
+
+    send("hi");
+    reactor.work();
+    ASSERT_EQ(thread->messages.size(), 3UL);
+    EXPECT_EQ(thread->messages[2], "ghi");
+}
+
+TEST_F(StreamReaderTest, TooLarge) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    StreamReader reader(buffer, fds[0]);
+    reader.setPrefixSize(2);
+    reader.setMaxSize(1000);
+    Pointer<ReaderThread> thread =
+        startReader(reactor, reader, [](StreamReader& r) { return r.readFrame(); });
+
+    // 0x1000 bytes announced
+    send(std::string("\x10\x00", 2));
+    reactor.work();
+    EXPECT_TRUE(thread->finished());
+    EXPECT_EQ(thread->status, StreamStatus::TooLarge);
+}
+
+TEST_F(StreamReaderTest, Timeout) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    StreamReader reader(buffer, fds[0]);
+    reader.setTimeout(DateTime::msecs(5));
+    Pointer<ReaderThread> thread =
+        startReader(reactor, reader, [](StreamReader& r) { return r.readUntil(0); });
+
+    send(std::string("one\0two", 6));
+    for (int loop = 0; (loop < 100) && !thread->finished(); ++loop) {
+        reactor.work();
+    }
+    EXPECT_TRUE(thread->finished());
+    ASSERT_EQ(thread->messages.size(), 1UL);
+    EXPECT_EQ(thread->messages[0], "one");
+    EXPECT_EQ(thread->status, StreamStatus::Timeout);
+    EXPECT_EQ(reader.available(), 2UL);
+}
@@ -0,0 +1,118 @@
+#include "TimerWheel.h"
+
+using namespace hbthreads;
+
+// Out of line definitions for ODR-used constants
+constexpr TimerWheel::TimerId TimerWheel::NullTimer;
+constexpr unsigned TimerWheel::SlotsPerLevel;
+constexpr unsigned TimerWheel::NumLevels;
+
+TimerWheel::TimerWheel(MemoryStorage* mem, DateTime tick, DateTime now)
+    : _start(now), _tick(tick), _current(0), _count(0), _entries(mem) {
+    assert(mem != nullptr && "MemoryStorage must not be null");
+    assert(tick.nsecs() > 0 && "Tick must be positive");
+    for (std::uint64_t& bits : _occupied) {
+        bits = 0;
+    }
+}
+
+std::uint64_t TimerWheel::toTicks(DateTime time) const {
+    std::int64_t elapsed = (time - _start).nsecs();
+    return elapsed > 0 ? std::uint64_t(elapsed / _tick.nsecs()) : 0;
+}
+
+TimerWheel::TimerId TimerWheel::add(LightThread* thread, DateTime deadline) {
+    EntryList freelist(_free, _entries);
+    EntryIndex index = freelist.pop_front();
+    if (index == SlotHead::NullIndex) {
+        index = _entries.size();
+        _entries.push_back(Entry{});
+        _entries[index].generation = 1;
+    }
+    // Round up so we never fire early
+    std::int64_t elapsed = (deadline - _start).nsecs();
+    std::uint64_t expiry = 0;
+    if (elapsed > 0) {
+        expiry = std::uint64_t((elapsed + _tick.nsecs() - 1) / _tick.nsecs());
+    }
+    Entry& entry(_entries[index]);
+    entry.expiry = expiry;
+    entry.thread = thread;
+    _count += 1;
+    insert(index);
+    return makeId(index);
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    EntryIndex index = TimerWheel::index(id);
+    if (index >= _entries.size()) return false;
+    Entry& entry(_entries[index]);
+    if (!entry.thread || (entry.generation != std::uint32_t(id >> 32))) return false;
+
+    SlotHead& head(_slots[entry.level][entry.slot]);
+    EntryList list(head, _entries);
+    list.remove(index);
+    if (head.first == SlotHead::NullIndex) {
+        _occupied[entry.level] &= ~(std::uint64_t(1) << entry.slot);
+    }
+    entry.thread.reset();
+    release(index);
+    return true;
+}
+
+DateTime TimerWheel::nextDeadline() const {
+    // The next busy slot of this block, otherwise the end of the block where
+    // the upper levels cascade. Later entries are found then.
+    unsigned slot = _current & SlotMask;
+    std::uint64_t pending = _occupied[0] >> slot;
+    if (pending != 0) {
+        return fromTicks(_current + __builtin_ctzll(pending));
+    }
+    return fromTicks((_current | SlotMask) + 1);
+}
+
+void TimerWheel::insert(EntryIndex index) {
+    Entry& entry(_entries[index]);
+    std::uint64_t expiry = entry.expiry < _current ? _current : entry.expiry;
+
+    // Too far for the top level: park it at the end of the span, it comes back
+    // down and is placed again when the wheel gets there
+    const unsigned span_bits = LevelBits * NumLevels;
+    if ((expiry >> span_bits) != (_current >> span_bits)) {
+        expiry = _current | ((std::uint64_t(1) << span_bits) - 1);
+    }
+
+    // Lowest level where we share the block of the level above with `_current`
+    unsigned level = 0;
+    while ((level < NumLevels - 1) && ((expiry >> (LevelBits * (level + 1))) !=
+                                       (_current >> (LevelBits * (level + 1))))) {
+        level += 1;
+    }
+    unsigned slot = (expiry >> (LevelBits * level)) & SlotMask;
+    entry.level = level;
+    entry.slot = slot;
+    EntryList list(_slots[level][slot], _entries);
+    list.push_back(index);
+    _occupied[level] |= std::uint64_t(1) << slot;
+}
+
+void TimerWheel::cascade(unsigned level, unsigned slot) {
+    if ((_occupied[level] & (std::uint64_t(1) << slot)) == 0) return;
+    SlotHead head = _slots[level][slot];
+    _slots[level][slot] = SlotHead();
+    _occupied[level] &= ~(std::uint64_t(1) << slot);
+    EntryList list(head, _entries);
+    for (EntryIndex index = list.pop_front(); index != SlotHead::NullIndex;
+         index = list.pop_front()) {
+        insert(index);
+    }
+}
+
+void TimerWheel::release(EntryIndex index) {
+    Entry& entry(_entries[index]);
+    entry.generation += 1;
+    if (entry.generation == 0) entry.generation = 1;
+    _count -= 1;
+    EntryList freelist(_free, _entries);
+    freelist.push_back(index);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "DateTime.h"
+#include "ImportedTypes.h"
+#include "IntrusiveIndexList.h"
+#include "LightThread.h"
+#include <cstdint>
+
+namespace hbthreads {
+
+//! Hierarchical timing wheel holding many timers without file descriptors.
+//! Time is cut in ticks and each of the NumLevels levels has SlotsPerLevel
+//! slots, every level covering SlotsPerLevel times the span of the one below.
+//! A timer sits in the lowest level whose span still contains its expiry and
+//! moves down a level each time the wheel reaches its slot, so arming and
+//! cancelling are O(1) and advancing costs one step per tick at most, skipping
+//! runs of empty slots. Timers beyond the top level just wrap around.
+//! Timers never fire early, they fire on the first tick after their deadline.
+//! Times are on the monotonic clock.
+class TimerWheel {
+public:
+    //! Identifies a timer. Ids are never reused so stale ones are harmless
+    using TimerId = std::uint64_t;
+
+    //! An id that never refers to a timer
+    static constexpr TimerId NullTimer = 0;
+
+    //! Starts the wheel at `now` with the given tick resolution
+    TimerWheel(MemoryStorage* mem, DateTime tick = DateTime::msecs(1),
+               DateTime now = DateTime::now(DateTime::ClockType::Monotonic));
+
+    //! Arms a timer for this thread
+    TimerId add(LightThread* thread, DateTime deadline);
+
+    //! Disarms the timer. Returns false if it already fired or was cancelled
+    bool cancel(TimerId id);
+
+    //! Number of armed timers
+    std::uint32_t size() const noexcept {
+        return _count;
+    }
+
+    //! Returns true if no timer is armed
+    bool empty() const noexcept {
+        return _count == 0;
+    }
+
+    //! Returns when the wheel needs to be advanced next, which may be before
+    //! the next timer is due. Only meaningful if not empty()
+    DateTime nextDeadline() const;
+
+    //! Fires all timers due by `now`, calling `fire(thread, id)` for each.
+    //! Timers can be armed from the callback.
+    template <typename Func>
+    void advance(DateTime now, Func&& fire);
+
+    //! Returns the index part of the id. Indexes are reused, compare whole ids
+    static std::uint32_t index(TimerId id) noexcept {
+        return std::uint32_t(id);
+    }
+
+private:
+    static constexpr unsigned LevelBits = 6;
+    static constexpr unsigned SlotsPerLevel = 1U << LevelBits;
+    static constexpr std::uint64_t SlotMask = SlotsPerLevel - 1;
+    static constexpr unsigned NumLevels = 4;
+
+    //! Entries are referred to by their position in `_entries`
+    using EntryIndex = std::uint32_t;
+
+    //! One timer, armed or free
+    struct Entry {
+        std::uint64_t expiry;         //! tick the timer fires on
+        Pointer<LightThread> thread;  //! who to notify, null if free
+        IntrusiveIndexListHook<EntryIndex> hook;  //! chain of the slot or free list
+        std::uint32_t generation;     //! bumped on release so ids are not reused
+        std::uint8_t level;           //! where it sits
+        std::uint8_t slot;
+    };
+
+    using EntryVector = Vector<Entry>;
+    using SlotHead = IntrusiveIndexListHead<EntryIndex>;
+    using EntryList = IntrusiveIndexList<Entry, EntryIndex, &Entry::hook, EntryVector>;
+
+    //! Places an armed entry in its slot relative to `_current`
+    void insert(EntryIndex index);
+
+    //! Moves all entries of one slot down to lower levels
+    void cascade(unsigned level, unsigned slot);
+
+    //! Returns the entry to the free list
+    void release(EntryIndex index);
+
+    //! Id of the entry as it is now
+    TimerId makeId(EntryIndex index) const noexcept {
+        return (TimerId(_entries[index].generation) << 32) | index;
+    }
+
+    //! Ticks elapsed from the start of the wheel, rounded down
+    std::uint64_t toTicks(DateTime time) const;
+
+    //! Start of the given tick
+    DateTime fromTicks(std::uint64_t ticks) const {
+        return _start + std::int64_t(ticks) * _tick;
+    }
+
+    DateTime _start;         //! when tick zero began
+    DateTime _tick;          //! duration of one tick
+    std::uint64_t _current;  //! next tick to process, all before are done
+    std::uint32_t _count;    //! armed timers
+    EntryVector _entries;    //! all entries
+    SlotHead _free;          //! entries ready for reuse
+    SlotHead _slots[NumLevels][SlotsPerLevel];  //! chains of armed entries
+    std::uint64_t _occupied[NumLevels];         //! bitmap of non-empty slots
+};
+
+template <typename Func>
+void TimerWheel::advance(DateTime now, Func&& fire) {
+    std::uint64_t target = toTicks(now);
+    while (_current <= target) {
+        if (_count == 0) {
+            _current = target + 1;
+            break;
+        }
+        // Entering a new block of level zero, bring the next entries down
+        // starting from the top so they trickle all the way
+        if ((_current & SlotMask) == 0) {
+            for (unsigned level = NumLevels - 1; level > 0; --level) {
+                std::uint64_t mask = (std::uint64_t(1) << (LevelBits * level)) - 1;
+                if ((_current & mask) == 0) {
+                    cascade(level, (_current >> (LevelBits * level)) & SlotMask);
+                }
+            }
+        }
+        // Jump to the end of the block if nothing is left in it
+        unsigned slot = _current & SlotMask;
+        if ((_occupied[0] >> slot) == 0) {
+            std::uint64_t next = (_current | SlotMask) + 1;
+            _current = next <= target ? next : target + 1;
+            continue;
+        }
+        if ((_occupied[0] & (std::uint64_t(1) << slot)) != 0) {
+            // Detach the slot as firing might arm new timers
+            SlotHead head = _slots[0][slot];
+            _slots[0][slot] = SlotHead();
+            _occupied[0] &= ~(std::uint64_t(1) << slot);
+            EntryList list(head, _entries);
+            for (EntryIndex index = list.pop_front(); index != SlotHead::NullIndex;
+                 index = list.pop_front()) {
+                if (_entries[index].expiry > _current) {
+                    // Wrapped around the top level, not yet
+                    insert(index);
+                    continue;
+                }
+                Pointer<LightThread> thread;
+                thread.swap(_entries[index].thread);
+                TimerId id = makeId(index);
+                release(index);
+                fire(thread.get(), id);
+            }
+        }
+        _current += 1;
+    }
+}
+
+}  // namespace hbthreads
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+#include "TimerWheel.h"
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace hbthreads;
+
+namespace {
+
+// Never started, just a target for timers
+class IdleThread : public LightThread {
+public:
+    void run() override {
+    }
+};
+
+}  // namespace
+
+class TimerWheelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+        thread = new IdleThread;
+    }
+
+    void TearDown() override {
+        thread.reset();
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    // Arbitrary origin so tests do not depend on the clock
+    const DateTime start = DateTime::secs(1000);
+
+    Pointer<LightThread> thread;
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+};
+
+TEST_F(TimerWheelTest, Empty) {
+    TimerWheel wheel(storage, DateTime::msecs(1), start);
+    EXPECT_TRUE(wheel.empty());
+    int fired = 0;
+    wheel.advance(start + DateTime::secs(10),
+                  [&fired](LightThread*, TimerWheel::TimerId) { fired++; });
+    EXPECT_EQ(fired, 0);
+    EXPECT_FALSE(wheel.cancel(TimerWheel::NullTimer));
+}
+
+TEST_F(TimerWheelTest, FiresOnTimeAcrossLevels) {
+    TimerWheel wheel(storage, DateTime::msecs(1), start);
+    // Level zero, level one, level two, level three and beyond the wheel span
+    const std::int64_t delays_ms[] = {5, 1, 70, 5000, 300000, 20 * 3600 * 1000LL};
+    std::map<TimerWheel::TimerId, DateTime> deadlines;
+    for (std::int64_t delay : delays_ms) {
+        DateTime deadline = start + DateTime::msecs(delay) + DateTime::usecs(300);
+        deadlines[wheel.add(thread.get(), deadline)] = deadline;
+    }
+    EXPECT_EQ(wheel.size(), 6U);
+
+    // Walk in uneven steps, every timer fires in the first step past its deadline
+    DateTime now = start;
+    DateTime last = start;
+    int fired = 0;
+    while (!wheel.empty()) {
+        last = now;
+        now += DateTime::usecs(700);
+        if (wheel.nextDeadline() > now + DateTime::msecs(2)) {
+            now = wheel.nextDeadline();
+        }
+        wheel.advance(now, [&](LightThread* target, TimerWheel::TimerId id) {
+            EXPECT_EQ(target, thread.get());
+            ASSERT_EQ(deadlines.count(id), 1UL);
+            EXPECT_GE(now, deadlines[id]);
+            // Late by at most one tick
+            EXPECT_LT(last, deadlines[id] + DateTime::msecs(1));
+            fired++;
+        });
+    }
+    EXPECT_EQ(fired, 6);
+}
+
+TEST_F(TimerWheelTest, NextDeadlineIsNeverLate) {
+    TimerWheel wheel(storage, DateTime::msecs(1), start);
+    wheel.add(thread.get(), start + DateTime::msecs(10));
+    EXPECT_EQ(wheel.nextDeadline(), start + DateTime::msecs(10));
+    wheel.add(thread.get(), start + DateTime::msecs(3));
+    EXPECT_EQ(wheel.nextDeadline(), start + DateTime::msecs(3));
+
+    // Far timers only ask to be looked at when the level below runs out
+    TimerWheel far(storage, DateTime::msecs(1), start);
+    far.add(thread.get(), start + DateTime::secs(100));
+    EXPECT_LE(far.nextDeadline(), start + DateTime::msecs(64));
+}
+
+TEST_F(TimerWheelTest, Cancel) {
+    TimerWheel wheel(storage, DateTime::msecs(1), start);
+    TimerWheel::TimerId keep = wheel.add(thread.get(), start + DateTime::msecs(10));
+    TimerWheel::TimerId drop = wheel.add(thread.get(), start + DateTime::msecs(10));
+    TimerWheel::TimerId far = wheel.add(thread.get(), start + DateTime::secs(10));
+    EXPECT_TRUE(wheel.cancel(drop));
+    EXPECT_FALSE(wheel.cancel(drop));
+    EXPECT_TRUE(wheel.cancel(far));
+    EXPECT_EQ(wheel.size(), 1U);
+
+    std::vector<TimerWheel::TimerId> fired;
+    auto record = [&fired](LightThread*, TimerWheel::TimerId id) { fired.push_back(id); };
+    wheel.advance(start + DateTime::secs(20), record);
+    ASSERT_EQ(fired.size(), 1UL);
+    EXPECT_EQ(fired[0], keep);
+
+    // Ids of fired timers are dead even once all slots are reused
+    EXPECT_FALSE(wheel.cancel(keep));
+    std::vector<TimerWheel::TimerId> reused;
+    for (int j = 0; j < 3; ++j) {
+        reused.push_back(wheel.add(thread.get(), start + DateTime::secs(30)));
+    }
+    EXPECT_FALSE(wheel.cancel(keep));
+    EXPECT_FALSE(wheel.cancel(drop));
+    for (TimerWheel::TimerId id : reused) {
+        EXPECT_NE(id, keep);
+        EXPECT_TRUE(wheel.cancel(id));
+    }
+}
+
+TEST_F(TimerWheelTest, PastDeadlinesFireOnNextTick) {
+    TimerWheel wheel(storage, DateTime::msecs(1), start);
+    int fired = 0;
+    auto count = [&fired](LightThread*, TimerWheel::TimerId) { fired++; };
+    DateTime now = start + DateTime::secs(1);
+    wheel.advance(now, count);
+    wheel.add(thread.get(), start);
+    wheel.advance(now, count);
+    EXPECT_EQ(fired, 0);
+    wheel.advance(now + DateTime::msecs(1), count);
+    EXPECT_EQ(fired, 1);
+}
+
+TEST_F(TimerWheelTest, RandomTimers) {
+    TimerWheel wheel(storage, DateTime::usecs(100), start);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<std::int64_t> delay(0, 2000000);  // up to 2s in us
+    std::uniform_int_distribution<std::int64_t> step(1, 5000);
+    std::map<TimerWheel::TimerId, DateTime> deadlines;
+    for (int j = 0; j < 2000; ++j) {
+        DateTime deadline = start + DateTime::usecs(delay(rng));
+        deadlines[wheel.add(thread.get(), deadline)] = deadline;
+    }
+    DateTime now = start;
+    DateTime last = start;
+    int fired = 0;
+    while (!wheel.empty()) {
+        last = now;
+        now += DateTime::usecs(step(rng));
+        wheel.advance(now, [&](LightThread*, TimerWheel::TimerId id) {
+            EXPECT_GE(now, deadlines[id]);
+            // Late by at most one tick
+            EXPECT_LT(last, deadlines[id] + DateTime::usecs(100));
+            fired++;
+        });
+    }
+    EXPECT_EQ(fired, 2000);
+}
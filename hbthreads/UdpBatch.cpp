@@ -0,0 +1,134 @@
+#include "UdpBatch.h"
+#include "SocketUtils.h"
+#include <errno.h>
+#include <string.h>
+
+using namespace hbthreads;
+
+// Control buffers are counted in whole headers so the storage aligns them for
+// CMSG_FIRSTHDR(), whatever it is
+static constexpr std::size_t ControlSlots =
+    (TimestampControlSize + sizeof(cmsghdr) - 1) / sizeof(cmsghdr);
+
+UdpBatchReceiver::UdpBatchReceiver(MemoryStorage* mem, std::size_t batch,
+                                   std::size_t mtu)
+    : _mtu(mtu),
+      _count(0),
+      _buffers(mem),
+      _iovecs(mem),
+      _controls(mem),
+      _headers(mem),
+      _datagrams(mem) {
+    assert(batch > 0 && "Batch size must not be zero");
+    assert(mtu > 0 && "MTU must not be zero");
+    _buffers.resize(batch * mtu);
+    _iovecs.resize(batch);
+    _controls.resize(batch * ControlSlots);
+    _headers.resize(batch);
+    _datagrams.resize(batch);
+
+    // Everything points into the arenas for good, only lengths change
+    for (std::size_t j = 0; j < batch; ++j) {
+        _iovecs[j].iov_base = &_buffers[j * mtu];
+        _iovecs[j].iov_len = mtu;
+        msghdr& hdr(_headers[j].msg_hdr);
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = &_iovecs[j];
+        hdr.msg_iovlen = 1;
+        hdr.msg_name = &_datagrams[j].source;
+        hdr.msg_control = &_controls[j * ControlSlots];
+        _datagrams[j].data = &_buffers[j * mtu];
+    }
+}
+
+int UdpBatchReceiver::receive(int fd) {
+    _count = 0;
+    // The kernel overwrites the address and control lengths so they are reset
+    // every time
+    for (mmsghdr& msg : _headers) {
+        msg.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msg.msg_hdr.msg_controllen = TimestampControlSize;
+    }
+    int res = ::recvmmsg(fd, _headers.data(), _headers.size(), MSG_DONTWAIT, nullptr);
+    if (res < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    for (int j = 0; j < res; ++j) {
+        Datagram& dgram(_datagrams[j]);
+        dgram.size = _headers[j].msg_len;
+        dgram.truncated = (_headers[j].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+        if (!parseReceiveTimestamp(&_headers[j].msg_hdr, &dgram.timestamp)) {
+            dgram.timestamp = DateTime::zero();
+        }
+    }
+    _count = res;
+    return res;
+}
+
+UdpBatchSender::UdpBatchSender(MemoryStorage* mem, std::size_t batch, std::size_t mtu)
+    : _mtu(mtu),
+      _first(0),
+      _count(0),
+      _buffers(mem),
+      _iovecs(mem),
+      _headers(mem),
+      _destinations(mem) {
+    assert(batch > 0 && "Batch size must not be zero");
+    assert(mtu > 0 && "MTU must not be zero");
+    _buffers.resize(batch * mtu);
+    _iovecs.resize(batch);
+    _headers.resize(batch);
+    _destinations.resize(batch);
+
+    for (std::size_t j = 0; j < batch; ++j) {
+        _iovecs[j].iov_base = &_buffers[j * mtu];
+        msghdr& hdr(_headers[j].msg_hdr);
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_iov = &_iovecs[j];
+        hdr.msg_iovlen = 1;
+    }
+}
+
+char* UdpBatchSender::next() noexcept {
+    if (_count == _headers.size()) return nullptr;
+    return &_buffers[_count * _mtu];
+}
+
+bool UdpBatchSender::commit(std::size_t size, const sockaddr_in* destination) noexcept {
+    if ((_count == _headers.size()) || (size > _mtu)) return false;
+    _iovecs[_count].iov_len = size;
+    msghdr& hdr(_headers[_count].msg_hdr);
+    if (destination != nullptr) {
+        _destinations[_count] = *destination;
+        hdr.msg_name = &_destinations[_count];
+        hdr.msg_namelen = sizeof(sockaddr_in);
+    } else {
+        hdr.msg_name = nullptr;
+        hdr.msg_namelen = 0;
+    }
+    _count += 1;
+    return true;
+}
+
+bool UdpBatchSender::add(const void* data, std::size_t size,
+                         const sockaddr_in* destination) noexcept {
+    char* buffer = next();
+    if ((buffer == nullptr) || (size > _mtu)) return false;
+    memcpy(buffer, data, size);
+    return commit(size, destination);
+}
+
+int UdpBatchSender::flush(int fd) {
+    if (_first == _count) return 0;
+    int res = ::sendmmsg(fd, &_headers[_first], _count - _first, MSG_DONTWAIT);
+    if (res < 0) {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    // Start over once everything is gone, otherwise resume from there
+    _first += res;
+    if (_first == _count) {
+        _first = 0;
+        _count = 0;
+    }
+    return res;
+}
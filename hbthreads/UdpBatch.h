@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ImportedTypes.h"
+#include "DateTime.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <cstddef>
+
+namespace hbthreads {
+
+//! One datagram received by UdpBatchReceiver. The payload lives in the
+//! receiver arena and is only valid until the next `receive()`
+struct Datagram {
+    const char* data;    //! payload
+    std::uint32_t size;  //! payload bytes, at most the receiver mtu
+    bool truncated;      //! the datagram was larger than the mtu and was cut
+    sockaddr_in source;  //! where it came from
+    DateTime timestamp;  //! kernel receive time, zero unless enabled on the socket
+};
+
+//! Reads bursts of datagrams with one recvmmsg() call instead of one read()
+//! per datagram. Payload buffers, iovecs and message headers are allocated
+//! once from the memory storage and reused, so receiving does not allocate.
+//! Typical use in a light thread subscribed to the socket:
+//!     while (receiver.receive(fd) > 0) {
+//!         for (const Datagram& dgram : receiver) { ... }
+//!     }
+//! Receive timestamps are filled in if the socket has them enabled, see
+//! `setSocketTimestamps()`.
+//! Not thread safe - use one per thread like the memory storage.
+class UdpBatchReceiver {
+public:
+    //! Prepares room for `batch` datagrams of up to `mtu` bytes each
+    UdpBatchReceiver(MemoryStorage* mem, std::size_t batch = 64, std::size_t mtu = 2048);
+
+    UdpBatchReceiver(const UdpBatchReceiver&) = delete;
+    UdpBatchReceiver& operator=(const UdpBatchReceiver&) = delete;
+
+    //! Reads as many datagrams as are pending, up to the batch size, without
+    //! blocking. Returns the number received, 0 if there was nothing to read
+    //! or -1 on error with errno set
+    int receive(int fd);
+
+    //! Range over the datagrams of the last `receive()`
+    const Datagram* begin() const noexcept {
+        return _datagrams.data();
+    }
+    const Datagram* end() const noexcept {
+        return _datagrams.data() + _count;
+    }
+
+    //! Returns one datagram of the last `receive()`
+    const Datagram& operator[](std::size_t index) const noexcept {
+        return _datagrams[index];
+    }
+
+    //! Number of datagrams of the last `receive()`
+    std::size_t size() const noexcept {
+        return _count;
+    }
+
+    //! Maximum number of datagrams per `receive()`
+    std::size_t capacity() const noexcept {
+        return _datagrams.size();
+    }
+
+    //! Size of each payload buffer
+    std::size_t mtu() const noexcept {
+        return _mtu;
+    }
+
+private:
+    std::size_t _mtu;             //! size of each payload buffer
+    std::size_t _count;           //! datagrams in the last batch
+    Vector<char> _buffers;        //! payload arena, `mtu` bytes per datagram
+    Vector<iovec> _iovecs;        //! one per datagram, pointing into `_buffers`
+    Vector<cmsghdr> _controls;    //! room for the timestamp of each datagram
+    Vector<mmsghdr> _headers;     //! handed to recvmmsg()
+    Vector<Datagram> _datagrams;  //! what we hand to the user
+};
+
+//! Queues datagrams and sends them with one sendmmsg() call.
+//! Datagrams are either copied in with `add()` or written in place into the
+//! buffer returned by `next()` then queued with `commit()`, which saves the
+//! copy. Buffers are allocated once from the memory storage.
+//! Not thread safe - use one per thread like the memory storage.
+class UdpBatchSender {
+public:
+    //! Prepares room for `batch` datagrams of up to `mtu` bytes each
+    UdpBatchSender(MemoryStorage* mem, std::size_t batch = 64, std::size_t mtu = 2048);
+
+    UdpBatchSender(const UdpBatchSender&) = delete;
+    UdpBatchSender& operator=(const UdpBatchSender&) = delete;
+
+    //! Returns the buffer of the next datagram, `mtu()` bytes long, or null
+    //! if the batch is full. It is only queued once committed
+    char* next() noexcept;
+
+    //! Queues the datagram written into `next()`. A null destination sends
+    //! to the address the socket is connected to. Returns false if the batch
+    //! is full or the size is larger than the mtu
+    bool commit(std::size_t size, const sockaddr_in* destination = nullptr) noexcept;
+
+    //! Copies and queues one datagram, see `commit()`
+    bool add(const void* data, std::size_t size,
+             const sockaddr_in* destination = nullptr) noexcept;
+
+    //! Sends the queued datagrams without blocking. Returns the number sent or
+    //! -1 on error with errno set. Datagrams the socket had no room for stay
+    //! queued for the next call, typically after a SocketWriteable event
+    int flush(int fd);
+
+    //! Number of datagrams waiting to be sent
+    std::size_t pending() const noexcept {
+        return _count - _first;
+    }
+
+    //! Maximum number of queued datagrams
+    std::size_t capacity() const noexcept {
+        return _headers.size();
+    }
+
+    //! Size of each payload buffer
+    std::size_t mtu() const noexcept {
+        return _mtu;
+    }
+
+private:
+    std::size_t _mtu;                   //! size of each payload buffer
+    std::size_t _first;                 //! first datagram not sent yet
+    std::size_t _count;                 //! datagrams queued
+    Vector<char> _buffers;              //! payload arena, `mtu` bytes per datagram
+    Vector<iovec> _iovecs;              //! one per datagram, pointing into `_buffers`
+    Vector<mmsghdr> _headers;           //! handed to sendmmsg()
+    Vector<sockaddr_in> _destinations;  //! per datagram destination
+};
+
+}  // namespace hbthreads
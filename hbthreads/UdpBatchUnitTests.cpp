@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+#include "UdpBatch.h"
+#include "SocketUtils.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+using namespace hbthreads;
+
+class UdpBatchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+
+        // Receiver on an ephemeral loopback port, sender anywhere
+        rxfd = createUDPSocket();
+        ASSERT_GE(rxfd, 0);
+        ASSERT_TRUE(bindSocket(rxfd, "127.0.0.1", 0));
+        socklen_t len = sizeof(address);
+        ASSERT_EQ(0, getsockname(rxfd, (sockaddr*)&address, &len));
+        txfd = createUDPSocket();
+        ASSERT_GE(txfd, 0);
+    }
+
+    void TearDown() override {
+        ::close(rxfd);
+        ::close(txfd);
+        delete buffer;
+        delete pool;
+    }
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+    int rxfd;
+    int txfd;
+    sockaddr_in address;
+};
+
+TEST_F(UdpBatchTest, NothingToReceive) {
+    UdpBatchReceiver receiver(buffer, 8, 256);
+    EXPECT_EQ(receiver.capacity(), 8UL);
+    EXPECT_EQ(receiver.mtu(), 256UL);
+    EXPECT_EQ(receiver.receive(rxfd), 0);
+    EXPECT_EQ(receiver.size(), 0UL);
+    EXPECT_EQ(receiver.begin(), receiver.end());
+}
+
+TEST_F(UdpBatchTest, SendAndReceiveBatch) {
+    const int NUM_DATAGRAMS = 20;
+    UdpBatchSender sender(buffer, 32, 256);
+    UdpBatchReceiver receiver(buffer, 8, 256);
+
+    for (int j = 0; j < NUM_DATAGRAMS; ++j) {
+        std::string msg = "datagram " + std::to_string(j);
+        ASSERT_TRUE(sender.add(msg.data(), msg.size(), &address));
+    }
+    EXPECT_EQ(sender.pending(), std::size_t(NUM_DATAGRAMS));
+    EXPECT_EQ(sender.flush(txfd), NUM_DATAGRAMS);
+    EXPECT_EQ(sender.pending(), 0UL);
+
+    // Comes out in batches of at most 8, in order
+    int received = 0;
+    int res;
+    while ((res = receiver.receive(rxfd)) > 0) {
+        EXPECT_LE(res, 8);
+        EXPECT_EQ(receiver.size(), std::size_t(res));
+        for (const Datagram& dgram : receiver) {
+            std::string msg = "datagram " + std::to_string(received);
+            EXPECT_EQ(std::string(dgram.data, dgram.size), msg);
+            EXPECT_FALSE(dgram.truncated);
+            EXPECT_EQ(dgram.source.sin_family, AF_INET);
+            received++;
+        }
+    }
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(received, NUM_DATAGRAMS);
+}
+
+TEST_F(UdpBatchTest, WriteInPlace) {
+    UdpBatchSender sender(buffer, 2, 64);
+    UdpBatchReceiver receiver(buffer, 4, 64);
+
+    // Connected sockets need no destination
+    ASSERT_EQ(0, ::connect(txfd, (sockaddr*)&address, sizeof(address)));
+    for (int j = 0; j < 2; ++j) {
+        char* buf = sender.next();
+        ASSERT_NE(buf, nullptr);
+        buf[0] = char('a' + j);
+        EXPECT_TRUE(sender.commit(1));
+    }
+
+    // The batch is full until flushed
+    EXPECT_EQ(sender.next(), nullptr);
+    EXPECT_FALSE(sender.add("x", 1));
+    EXPECT_EQ(sender.flush(txfd), 2);
+    EXPECT_NE(sender.next(), nullptr);
+    EXPECT_EQ(sender.flush(txfd), 0);
+
+    ASSERT_EQ(receiver.receive(rxfd), 2);
+    EXPECT_EQ(receiver[0].data[0], 'a');
+    EXPECT_EQ(receiver[1].data[0], 'b');
+
+    // The receiver knows where it came from
+    sockaddr_in local;
+    socklen_t len = sizeof(local);
+    ASSERT_EQ(0, getsockname(txfd, (sockaddr*)&local, &len));
+    EXPECT_EQ(receiver[0].source.sin_port, local.sin_port);
+}
+
+TEST_F(UdpBatchTest, Truncation) {
+    UdpBatchSender sender(buffer, 4, 128);
+    UdpBatchReceiver receiver(buffer, 4, 16);
+
+    char payload[100];
+    memset(payload, 'z', sizeof(payload));
+    EXPECT_FALSE(sender.add(payload, 200, &address));
+    EXPECT_TRUE(sender.add(payload, sizeof(payload), &address));
+    EXPECT_EQ(sender.flush(txfd), 1);
+
+    ASSERT_EQ(receiver.receive(rxfd), 1);
+    EXPECT_TRUE(receiver[0].truncated);
+    EXPECT_EQ(receiver[0].size, 16U);
+}
+
+TEST_F(UdpBatchTest, Timestamps) {
+    UdpBatchSender sender(buffer, 4, 64);
+    UdpBatchReceiver receiver(buffer, 4, 64);
+
+    ASSERT_TRUE(sender.add("a", 1, &address));
+    ASSERT_EQ(sender.flush(txfd), 1);
+    ASSERT_EQ(receiver.receive(rxfd), 1);
+    EXPECT_EQ(receiver[0].timestamp, DateTime::zero());
+
+    // Every datagram gets its own kernel stamp. The first one only warms up
+    // the kernel, which turns stamping on a bit later
+    ASSERT_TRUE(setSocketTimestamps(rxfd));
+    ASSERT_TRUE(sender.add("w", 1, &address));
+    ASSERT_EQ(sender.flush(txfd), 1);
+    ASSERT_EQ(receiver.receive(rxfd), 1);
+    DateTime before = DateTime::now();
+    for (int j = 0; j < 4; ++j) {
+        ASSERT_TRUE(sender.add("b", 1, &address));
+    }
+    ASSERT_EQ(sender.flush(txfd), 4);
+    ASSERT_EQ(receiver.receive(rxfd), 4);
+    DateTime last = before;
+    for (const Datagram& dgram : receiver) {
+        EXPECT_GE(dgram.timestamp, last);
+        last = dgram.timestamp;
+    }
+}
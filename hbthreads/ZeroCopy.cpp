@@ -0,0 +1,137 @@
+#include "ZeroCopy.h"
+#include "SocketUtils.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace hbthreads;
+
+// C++14 needs these defined somewhere in case they are bound to references
+constexpr std::size_t ZeroCopySender::CompactSize;
+
+ZeroCopySender::ZeroCopySender(MemoryStorage* mem, int fd, std::size_t min_size)
+    : _fd(fd),
+      _min_size(min_size),
+      _zerocopy(false),
+      _buffers(mem),
+      _head(0),
+      _unsent(0),
+      _next_id(0),
+      _done(0),
+      _copied(0) {
+    assert(mem != nullptr && "MemoryStorage must not be null");
+    _zerocopy = setSocketZeroCopy(fd);
+}
+
+ZeroCopySender::~ZeroCopySender() {
+    for (std::size_t j = _head; j < _buffers.size(); ++j) {
+        const Buffer& buf(_buffers[j]);
+        buf.release(buf.context, buf.data, buf.size);
+    }
+}
+
+bool ZeroCopySender::write(const void* data, std::size_t size, Release release,
+                           void* context) {
+    assert(release != nullptr && "Release callback must not be null");
+    Buffer buf;
+    buf.data = static_cast<const char*>(data);
+    buf.size = size;
+    buf.sent = 0;
+    buf.last = 0;
+    buf.zerocopy = _zerocopy && (size >= _min_size);
+    buf.release = release;
+    buf.context = context;
+    _buffers.push_back(buf);
+    return flush();
+}
+
+bool ZeroCopySender::flush() {
+    while (_unsent < _buffers.size()) {
+        Buffer& buf(_buffers[_unsent]);
+        int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+        if (buf.zerocopy) flags |= MSG_ZEROCOPY;
+        ssize_t nb = 0;
+        if (buf.sent < buf.size) {
+            nb = ::send(_fd, buf.data + buf.sent, buf.size - buf.sent, flags);
+        }
+        if (nb < 0) {
+            if (errno == EINTR) continue;
+            // ENOBUFS means too many completions are pending, wait for them
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ENOBUFS)) break;
+            return false;
+        }
+        // Every successful zero copy send gets the next id
+        if (buf.zerocopy && (nb > 0)) {
+            buf.last = _next_id++;
+        }
+        buf.sent += nb;
+        if (buf.sent < buf.size) break;
+        _unsent++;
+    }
+    // Copied buffers are free to go as soon as they are sent
+    release();
+    return true;
+}
+
+int ZeroCopySender::complete() {
+    while (true) {
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err)) +
+                                      CMSG_SPACE(sizeof(sockaddr_in6))];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+            return -1;
+        }
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool ipv4 = (cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR);
+            bool ipv6 =
+                (cmsg->cmsg_level == SOL_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR);
+            if (!ipv4 && !ipv6) continue;
+            sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if ((err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) || (err.ee_errno != 0)) continue;
+            // Sends from ee_info to ee_data, both included, are done.
+            // Stream sockets complete them in order
+            std::uint32_t end = err.ee_data + 1;
+            if ((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0) {
+                _copied += end - err.ee_info;
+            }
+            if (std::int32_t(end - _done) > 0) {
+                _done = end;
+            }
+        }
+    }
+    return release();
+}
+
+int ZeroCopySender::release() {
+    int count = 0;
+    while (_head < _unsent) {
+        // Ids wrap around so compare the distance
+        const Buffer& buf(_buffers[_head]);
+        if (buf.zerocopy && (std::int32_t(buf.last - _done) >= 0)) break;
+        // The callback might write again and move the buffers around
+        Buffer done = buf;
+        _head++;
+        done.release(done.context, done.data, done.size);
+        count++;
+    }
+    if (_head == _buffers.size()) {
+        _buffers.clear();
+        _head = 0;
+        _unsent = 0;
+    } else if ((_head >= CompactSize) && (2 * _head >= _buffers.size())) {
+        // Keep a steady stream from growing the list forever
+        _buffers.erase(_buffers.begin(), _buffers.begin() + _head);
+        _unsent -= _head;
+        _head = 0;
+    }
+    return count;
+}
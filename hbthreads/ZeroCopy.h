@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ImportedTypes.h"
+#include <cstddef>
+
+namespace hbthreads {
+
+//! Sends buffers on a stream socket with MSG_ZEROCOPY, so the kernel reads
+//! them straight from user memory instead of copying them.
+//! The kernel keeps using a buffer after send() returns so the sender owns it
+//! until the completion shows up in the socket error queue, then hands it back
+//! through its release callback. Buffers are released in the order written.
+//! The owning thread subscribes the socket with MonitorFlags::ErrorQueue and
+//! calls `complete()` on every EventType::ErrorQueue event, and `flush()` when
+//! the socket is writable again.
+//! Small buffers are cheaper to copy than to pin so they are sent normally,
+//! as is everything if the socket does not support SO_ZEROCOPY.
+//! Not thread safe - use one per thread like the memory storage.
+class ZeroCopySender {
+public:
+    //! Gives a buffer back to its owner
+    using Release = void (*)(void* context, const void* data, std::size_t size);
+
+    //! Enables SO_ZEROCOPY on the socket. Buffers smaller than `min_size` are
+    //! copied by the kernel as usual
+    ZeroCopySender(MemoryStorage* mem, int fd, std::size_t min_size = 16 * 1024);
+
+    //! Releases all buffers, even the ones the kernel might still be sending
+    ~ZeroCopySender();
+
+    ZeroCopySender(const ZeroCopySender&) = delete;
+    ZeroCopySender& operator=(const ZeroCopySender&) = delete;
+
+    //! Queues the buffer then sends as much as the socket takes, see `flush()`.
+    //! `release(context, data, size)` is called once the kernel is done with it
+    bool write(const void* data, std::size_t size, Release release, void* context);
+
+    //! Sends the queued buffers until the socket is full. Returns false on error
+    bool flush();
+
+    //! Reads the completions in the error queue and releases the buffers the
+    //! kernel is done with. Returns the number released or -1 on error
+    int complete();
+
+    //! Number of buffers owned by the sender, sent or not
+    std::size_t pending() const noexcept {
+        return _buffers.size() - _head;
+    }
+
+    //! Number of buffers not completely sent yet
+    std::size_t queued() const noexcept {
+        return _buffers.size() - _unsent;
+    }
+
+    //! Returns true if the socket accepted SO_ZEROCOPY
+    bool zerocopy() const noexcept {
+        return _zerocopy;
+    }
+
+    //! Number of zero copy sends the kernel ended up copying anyway, as it
+    //! does on loopback or with devices that cannot gather
+    std::uint64_t copied() const noexcept {
+        return _copied;
+    }
+
+private:
+    //! A buffer owned by the sender
+    struct Buffer {
+        const char* data;     //! the payload
+        std::size_t size;     //! payload bytes
+        std::size_t sent;     //! bytes handed to the kernel so far
+        std::uint32_t last;   //! id of the last zero copy send of this buffer
+        bool zerocopy;        //! sent with MSG_ZEROCOPY
+        Release release;      //! gives it back
+        void* context;        //! passed to `release`
+    };
+
+    //! Hands back the buffers that are completely sent and completed
+    int release();
+
+    //! Released entries are dropped from the front of the list past this many
+    static constexpr std::size_t CompactSize = 64;
+
+    int _fd;                  //! the socket
+    std::size_t _min_size;    //! smaller buffers are copied
+    bool _zerocopy;           //! SO_ZEROCOPY is enabled
+    Vector<Buffer> _buffers;  //! owned buffers in write order
+    std::size_t _head;        //! first buffer not released
+    std::size_t _unsent;      //! first buffer not completely sent
+    std::uint32_t _next_id;   //! id the kernel gives to the next zero copy send
+    std::uint32_t _done;      //! all ids before this one completed
+    std::uint64_t _copied;    //! completions flagged as copied
+};
+
+}  // namespace hbthreads
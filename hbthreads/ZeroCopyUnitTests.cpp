@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include "EpollReactor.h"
+#include "SocketUtils.h"
+#include "ZeroCopy.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace hbthreads;
+
+namespace {
+
+// Counts the buffers given back and checks they come in order
+struct ReleaseLog {
+    std::vector<const void*> buffers;
+
+    static void release(void* context, const void* data, std::size_t /*size*/) {
+        static_cast<ReleaseLog*>(context)->buffers.push_back(data);
+    }
+};
+
+// Reads everything available on a non-blocking socket
+std::size_t drain(int fd) {
+    std::size_t total = 0;
+    char buf[64 * 1024];
+    ssize_t nb;
+    while ((nb = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        total += nb;
+    }
+    return total;
+}
+
+// Finishes the sends with the completions it gets from the reactor
+class CompletionThread : public LightThread {
+public:
+    CompletionThread(ZeroCopySender* sender) : sender(sender) {
+    }
+    ZeroCopySender* sender;
+    int completions = 0;
+    int released = 0;
+
+    void run() override {
+        while (true) {
+            for (const Event& ev : *wait()) {
+                if (ev.type == EventType::ErrorQueue) {
+                    completions++;
+                    released += sender->complete();
+                }
+            }
+        }
+    }
+};
+
+}  // namespace
+
+class ZeroCopyTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool = new boost::container::pmr::monotonic_buffer_resource(64 * 1024ULL);
+        buffer = new boost::container::pmr::unsynchronized_pool_resource(pool);
+        storage = buffer;
+
+        // A connected TCP pair over loopback
+        int listener = createAndBindTCPSocket("127.0.0.1", 0);
+        ASSERT_GE(listener, 0);
+        ASSERT_EQ(0, ::listen(listener, 1));
+        sockaddr_in address;
+        socklen_t len = sizeof(address);
+        ASSERT_EQ(0, getsockname(listener, (sockaddr*)&address, &len));
+        txfd = createTCPSocket();
+        ASSERT_GE(txfd, 0);
+        ASSERT_EQ(0, ::connect(txfd, (sockaddr*)&address, sizeof(address)));
+        rxfd = ::accept(listener, nullptr, nullptr);
+        ASSERT_GE(rxfd, 0);
+        ::close(listener);
+
+        payload.resize(4 * BufferSize);
+        for (std::size_t j = 0; j < payload.size(); ++j) {
+            payload[j] = char(j);
+        }
+    }
+
+    void TearDown() override {
+        ::close(txfd);
+        ::close(rxfd);
+        delete buffer;
+        delete pool;
+        storage = nullptr;
+    }
+
+    static constexpr std::size_t BufferSize = 32 * 1024;
+
+    boost::container::pmr::monotonic_buffer_resource* pool;
+    boost::container::pmr::unsynchronized_pool_resource* buffer;
+    int txfd;
+    int rxfd;
+    std::vector<char> payload;
+};
+
+constexpr std::size_t ZeroCopyTest::BufferSize;
+
+TEST_F(ZeroCopyTest, BuffersReleasedAfterCompletion) {
+    ReleaseLog log;
+    ZeroCopySender sender(buffer, txfd);
+    ASSERT_TRUE(sender.zerocopy());
+
+    for (int j = 0; j < 4; ++j) {
+        const char* data = &payload[j * BufferSize];
+        ASSERT_TRUE(sender.write(data, BufferSize, ReleaseLog::release, &log));
+    }
+
+    // Nothing goes back until the kernel says so
+    EXPECT_EQ(log.buffers.size(), 0UL);
+    EXPECT_EQ(sender.pending(), 4UL);
+
+    std::size_t received = 0;
+    for (int loop = 0; (loop < 1000) && (sender.pending() > 0); ++loop) {
+        received += drain(rxfd);
+        ASSERT_TRUE(sender.flush());
+        ASSERT_GE(sender.complete(), 0);
+        usleep(100);
+    }
+    received += drain(rxfd);
+    EXPECT_EQ(received, payload.size());
+    EXPECT_EQ(sender.pending(), 0UL);
+    ASSERT_EQ(log.buffers.size(), 4UL);
+    for (int j = 0; j < 4; ++j) {
+        EXPECT_EQ(log.buffers[j], &payload[j * BufferSize]);
+    }
+    // Loopback cannot send from user memory
+    EXPECT_GT(sender.copied(), 0UL);
+}
+
+TEST_F(ZeroCopyTest, SmallBuffersAreCopied) {
+    ReleaseLog log;
+    ZeroCopySender sender(buffer, txfd, BufferSize + 1);
+
+    // Sent the usual way so they are released right away
+    ASSERT_TRUE(sender.write(&payload[0], BufferSize, ReleaseLog::release, &log));
+    ASSERT_TRUE(sender.write(&payload[BufferSize], 100, ReleaseLog::release, &log));
+    EXPECT_EQ(log.buffers.size(), 2UL);
+    EXPECT_EQ(sender.pending(), 0UL);
+    EXPECT_EQ(sender.complete(), 0);
+    EXPECT_EQ(drain(rxfd), BufferSize + 100);
+}
+
+TEST_F(ZeroCopyTest, DestructorReleasesEverything) {
+    ReleaseLog log;
+    {
+        ZeroCopySender sender(buffer, txfd);
+        ASSERT_TRUE(sender.write(&payload[0], BufferSize, ReleaseLog::release, &log));
+        EXPECT_EQ(log.buffers.size(), 0UL);
+    }
+    EXPECT_EQ(log.buffers.size(), 1UL);
+}
+
+TEST_F(ZeroCopyTest, CompletionsThroughReactor) {
+    EpollReactor reactor(buffer, DateTime::msecs(10));
+    ReleaseLog log;
+    ZeroCopySender sender(buffer, txfd);
+    Pointer<CompletionThread> thread(new CompletionThread(&sender));
+    thread->start(16 * 1024);
+    reactor.monitor(txfd, thread.get(), MonitorFlags::ErrorQueue);
+
+    ASSERT_TRUE(sender.write(&payload[0], BufferSize, ReleaseLog::release, &log));
+    for (int loop = 0; (loop < 100) && (log.buffers.size() == 0); ++loop) {
+        drain(rxfd);
+        reactor.work();
+    }
+
+    // Completions are not errors, the socket is still watched
+    EXPECT_GT(thread->completions, 0);
+    EXPECT_EQ(thread->released, 1);
+    EXPECT_EQ(log.buffers.size(), 1UL);
+    EXPECT_TRUE(reactor.isMonitoring(txfd, thread.get()));
+    reactor.removeThread(thread.get());
+}
@@ -0,0 +1,323 @@
+#include "Reactor.h"
+#include "StackPool.h"
+#include "TimerWheel.h"
+#include "AsmUtils.h"
+#include "Histogram.h"
+#include "SlabStorage.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace hbthreads;
+
+/**
+ * Micro benchmarks of the coroutine and reactor primitives
+ * Every operation is timed on its own in cycles and the samples are summarized
+ * through a Histogram. The output is one CSV line (or JSON object with --json)
+ * per benchmark so results can be compared between releases.
+ * Use --quick for a short smoke run.
+ */
+
+//! Number of bins of all histograms
+static const std::size_t NUMBINS = 1000;
+using CycleHistogram = Histogram<NUMBINS>;
+
+//! Output format
+static bool json = false;
+
+//! Prints one benchmark result
+void report(const char* name, const char* param, long value, CycleHistogram& hist) {
+    Stats stats = hist.summary();
+    double p90 = hist.percentile(90);
+    double p99 = hist.percentile(99);
+    if (json) {
+        printf("{\"benchmark\":\"%s\",\"%s\":%ld,\"samples\":%lu,\"average\":%.1f,"
+               "\"median\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"min\":%.0f,\"max\":%.0f}\n",
+               name, param, value, stats.samples, stats.average, stats.median, p90, p99,
+               hist.minvalue, hist.maxvalue);
+    } else {
+        printf("%s,%s=%ld,%lu,%.1f,%.1f,%.1f,%.1f,%.0f,%.0f\n", name, param, value,
+               stats.samples, stats.average, stats.median, p90, p99, hist.minvalue,
+               hist.maxvalue);
+    }
+}
+
+/**
+ * A reactor that does not watch anything so we can fire events at will
+ */
+struct FakeReactor : public Reactor {
+    FakeReactor(MemoryStorage* mem) : Reactor(mem) {
+    }
+    void onSocketOps(int /*fd*/, Operation /*ops*/) override {
+        // just ignore
+    }
+    void notify(int fd) {
+        notifyEvent(fd, EventType::SocketRead);
+    }
+    void run() {
+        runQueued();
+    }
+};
+
+/**
+ * Finishes right away - for spawn/teardown
+ */
+struct Task : public LightThread {
+    void run() override {
+    }
+};
+
+/**
+ * Waits forever - for switching and dispatching
+ */
+struct Worker : public LightThread {
+    void run() override {
+        while (true) {
+            wait();
+        }
+    }
+};
+
+//! Create, start and destroy one thread
+void benchSpawn(const char* name, std::size_t stack_size, int numloops) {
+    CycleHistogram hist(0, 50000);
+    for (int j = 0; j < numloops; ++j) {
+        uint64_t t0 = tic();
+        {
+            Pointer<Task> task(new Task);
+            task->start(stack_size);
+        }
+        hist.add(tic() - t0);
+    }
+    report(name, "stack", stack_size, hist);
+}
+
+//! One resume() into a thread and its wait() back
+void benchSwitch(int numloops) {
+    Pointer<Worker> worker(new Worker);
+    worker->start(16 * 1024);
+    Event event;
+    event.type = EventType::SocketRead;
+    event.fd = 0;
+    CycleHistogram hist(0, 1000);
+    for (int j = 0; j < numloops; ++j) {
+        uint64_t t0 = tic();
+        worker->resume(&event);
+        hist.add(tic() - t0);
+    }
+    report("switch", "threads", 1, hist);
+}
+
+//! Subscribing and unsubscribing with `numsubs` subscriptions spread over threads
+void benchSubscriptions(std::vector<Pointer<Worker>>& workers, int numsubs) {
+    Pointer<FakeReactor> reactor(new FakeReactor(storage));
+    CycleHistogram monitor(0, 2000);
+    CycleHistogram remove(0, 2000);
+    for (int fd = 0; fd < numsubs; ++fd) {
+        uint64_t t0 = tic();
+        reactor->monitor(fd, workers[fd % workers.size()].get());
+        monitor.add(tic() - t0);
+    }
+    // Report removal cost per subscription so counts are comparable
+    int per_thread = (numsubs + workers.size() - 1) / workers.size();
+    for (Pointer<Worker>& worker : workers) {
+        uint64_t t0 = tic();
+        reactor->removeThread(worker.get());
+        remove.add(double(tic() - t0) / per_thread);
+    }
+    report("monitor", "subscriptions", numsubs, monitor);
+    report("removeThread", "subscriptions", numsubs, remove);
+}
+
+//! One event delivered to `numsubs` threads
+void benchFanout(std::vector<Pointer<Worker>>& workers, int numsubs, int numloops) {
+    Pointer<FakeReactor> reactor(new FakeReactor(storage));
+    for (int j = 0; j < numsubs; ++j) {
+        reactor->monitor(0, workers[j].get());
+    }
+    CycleHistogram hist(0, 20000);
+    for (int j = 0; j < numloops; ++j) {
+        uint64_t t0 = tic();
+        reactor->notify(0);
+        hist.add(tic() - t0);
+    }
+    report("notifyEvent", "subscribers", numsubs, hist);
+    reactor->removeSocket(0);
+}
+
+//! Resuming a thread through the run queue instead of a socket
+void benchPost(int numloops) {
+    Pointer<FakeReactor> reactor(new FakeReactor(storage));
+    Pointer<Worker> worker(new Worker);
+    worker->start(4 * 1024);
+    Event event;
+    event.type = EventType::Wakeup;
+    event.fd = -1;
+    CycleHistogram hist(0, 1000);
+    for (int j = 0; j < numloops; ++j) {
+        uint64_t t0 = tic();
+        reactor->post(worker.get(), event);
+        reactor->run();
+        hist.add(tic() - t0);
+    }
+    report("post", "threads", 1, hist);
+}
+
+//! Arming and cancelling with `numtimers` timers already armed
+void benchTimers(int numtimers, int numloops) {
+    Pointer<Worker> worker(new Worker);
+    DateTime start = DateTime::now(DateTime::ClockType::Monotonic);
+    TimerWheel wheel(storage, DateTime::msecs(1), start);
+    for (int j = 0; j < numtimers; ++j) {
+        wheel.add(worker.get(), start + DateTime::msecs((int64_t(j) * 7919) % 100000));
+    }
+    CycleHistogram add(0, 2000);
+    CycleHistogram cancel(0, 2000);
+    for (int j = 0; j < numloops; ++j) {
+        DateTime deadline = start + DateTime::msecs((int64_t(j) * 7919) % 100000);
+        uint64_t t0 = tic();
+        TimerWheel::TimerId id = wheel.add(worker.get(), deadline);
+        uint64_t t1 = tic();
+        wheel.cancel(id);
+        uint64_t t2 = tic();
+        add.add(t1 - t0);
+        cancel.add(t2 - t1);
+    }
+    report("timer_add", "timers", numtimers, add);
+    report("timer_cancel", "timers", numtimers, cancel);
+}
+
+//! Something to count references to
+template <typename Policy>
+struct Counted : public BasicObject<Policy> {};
+
+//! Taking and dropping one reference with the given counting policy
+template <typename Policy>
+void benchRefcount(const char* name, int numloops) {
+    Pointer<Counted<Policy>> object(new Counted<Policy>);
+    CycleHistogram hist(0, 1000);
+    for (int j = 0; j < numloops; ++j) {
+        uint64_t t0 = tic();
+        {
+            Pointer<Counted<Policy>> copy(object);
+            asm volatile("" : : "r"(copy.get()) : "memory");
+        }
+        hist.add(tic() - t0);
+    }
+    report(name, "threads", 1, hist);
+}
+
+//! What the library asks of its memory storage: thread objects coming and
+//! going, a flat set of sockets growing and a reactor subscribing threads
+void benchStorage(const char* name, MemoryStorage* mem, int numloops) {
+    MemoryStorage* saved = storage;
+    storage = mem;
+    CycleHistogram thread(0, 2000);
+    CycleHistogram flatset(0, 20000);
+    CycleHistogram reactor(0, 50000);
+    std::vector<Pointer<Worker>> workers(8);
+    for (Pointer<Worker>& worker : workers) {
+        worker.reset(new Worker);
+    }
+    for (int j = 0; j < numloops; ++j) {
+        uint64_t t0 = tic();
+        {
+            Pointer<Task> task(new Task);
+        }
+        uint64_t t1 = tic();
+        {
+            FlatSet<int> sockets(mem);
+            for (int fd = 0; fd < 64; ++fd) {
+                sockets.insert(fd);
+            }
+        }
+        uint64_t t2 = tic();
+        {
+            Pointer<FakeReactor> fake(new FakeReactor(mem));
+            for (int fd = 0; fd < 64; ++fd) {
+                fake->monitor(fd, workers[fd % workers.size()].get());
+            }
+        }
+        uint64_t t3 = tic();
+        thread.add(t1 - t0);
+        flatset.add(t2 - t1);
+        reactor.add(t3 - t2);
+    }
+    std::string prefix(name);
+    report((prefix + "_thread").c_str(), "objects", 1, thread);
+    report((prefix + "_flatset").c_str(), "sockets", 64, flatset);
+    report((prefix + "_reactor").c_str(), "subscriptions", 64, reactor);
+    workers.clear();
+    storage = saved;
+}
+
+int main(int argc, char* argv[]) {
+    bool quick = false;
+    for (int j = 1; j < argc; ++j) {
+        if (strcmp(argv[j], "--quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[j], "--json") == 0) {
+            json = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--quick] [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+    const int numloops = quick ? 1000 : 100000;
+
+    // Usual to avoid mallocs
+    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+
+    if (!json) {
+        printf("benchmark,param,samples,average,median,p90,p99,min,max\n");
+    }
+
+    // Spawn and teardown, mapping stacks or recycling them
+    for (std::size_t stack_size : {4 * 1024, 64 * 1024, 1024 * 1024}) {
+        benchSpawn("spawn_mmap", stack_size, numloops / 10);
+        StackPool stacks;
+        stacks.reserve(stack_size, 1);
+        stack_pool = &stacks;
+        benchSpawn("spawn_pool", stack_size, numloops);
+        stack_pool = nullptr;
+    }
+
+    // Context switch round trip, directly and through the run queue
+    benchSwitch(numloops);
+    benchPost(numloops);
+
+    // Reference counting, plain against atomic
+    benchRefcount<LocalCount>("refcount_local", numloops);
+    benchRefcount<SharedCount>("refcount_shared", numloops);
+
+    // Memory storages, the usual boost pools against the size classes
+    {
+        boost::container::pmr::monotonic_buffer_resource mono(8 * 1024ULL);
+        boost::container::pmr::unsynchronized_pool_resource pools(&mono);
+        benchStorage("storage_pool", &pools, numloops);
+        SlabStorage slabs;
+        benchStorage("storage_slab", &slabs, numloops);
+    }
+
+    // Subscription management and dispatching
+    std::vector<Pointer<Worker>> workers(64);
+    for (Pointer<Worker>& worker : workers) {
+        worker.reset(new Worker);
+        worker->start(4 * 1024);
+    }
+    for (int numsubs : {64, 640, 6400, 64000}) {
+        benchSubscriptions(workers, numsubs);
+    }
+    for (int numsubs : {1, 8, 64}) {
+        benchFanout(workers, numsubs, numloops);
+    }
+
+    // Timers without file descriptors
+    for (int numtimers : {64, 6400, 64000}) {
+        benchTimers(numtimers, numloops);
+    }
+}
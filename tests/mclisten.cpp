@@ -3,6 +3,7 @@
 #include "Timer.h"
 #include "SocketUtils.h"
 #include "StringUtils.h"
+#include "UdpBatch.h"
 
 #include <iostream>
 #include <array>
@@ -16,23 +17,26 @@ using namespace hbthreads;
 
 struct MCastListener : public LightThread {
     //! Constructor
-    MCastListener() {
+    MCastListener(MemoryStorage* mem) : receiver(mem) {
     }
     void run() override {
-        // Create the sender socket
-        char buf[4096];
         while (true) {
-            // Wait for timer
+            // Wait for packets
             Event* ev = wait();
             if (ev == nullptr) continue;
 
-            // Consume the timer otherwise it will be called again right away
-            ssize_t nb = ::read(ev->fd, buf, sizeof(buf));
+            // Drain the whole burst, many datagrams per syscall
+            int nb;
+            while ((nb = receiver.receive(ev->fd)) > 0) {
+                for (const Datagram& dgram : receiver) {
+                    printhex(std::cout, dgram.data, dgram.size, "0x", 32);
+                }
+            }
             if (nb < 0) break;
-            if (nb == 0) continue;
-            printhex(std::cout, buf, nb, "0x", 32);
         }
     }
+
+    UdpBatchReceiver receiver;
 };
 
 int main(int argc, char* argv[]) {
@@ -63,7 +67,7 @@ int main(int argc, char* argv[]) {
     }
 
     // Create  the light servers for MCastListener and server
-    Pointer<MCastListener> mc(new MCastListener);
+    Pointer<MCastListener> mc(new MCastListener(storage));
     mc->start(stacksize);
 
     // Creates the event loop reactor
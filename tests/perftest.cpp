@@ -1,5 +1,8 @@
 #include "PollReactor.h"
 #include "EpollReactor.h"
+#ifdef HAVE_IO_URING
+#include "IoUringReactor.h"
+#endif
 #include "MallocHooks.h"
 #include "Timer.h"
 #include "AsmUtils.h"
@@ -7,6 +10,7 @@
 #include "Timer.h"
 
 #include <sys/eventfd.h>
+#include <string>
 
 using namespace hbthreads;
 
@@ -66,15 +70,12 @@ struct Consumer : public LightThread {
     }
 };
 
-int main() {
-    // Usual memory pooling
-    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
-    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
-    storage = &buffer;
-
-    // Create epoll reactor as non-blocking
+//! Runs the producer/consumer ping-pong on the given reactor and prints stats
+template <typename ReactorType>
+void run(const char* name) {
+    // Create the reactor as non-blocking
     const int64_t numloops = 100;
-    Pointer<EpollReactor> reactor(new EpollReactor(storage, DateTime::msecs(0)));
+    Pointer<ReactorType> reactor(new ReactorType(storage, DateTime::msecs(0)));
 
     // Create the eventfd descriptor
     int efd = eventfd(0, 0);
@@ -99,9 +100,32 @@ int main() {
     while (reactor->active()) {
         reactor->work();
     }
+    close(efd);
 
     // Print stats
     Stats stats = worker->hist.summary();
-    printf("Reaction: Average:%.0f cycles/iteration Median:%.0f cycles/iteration\n",
-           stats.average, stats.median);
+    printf("%s Reaction: Average:%.0f cycles/iteration Median:%.0f cycles/iteration\n",
+           name, stats.average, stats.median);
+}
+
+int main(int argc, char* argv[]) {
+    // Usual memory pooling
+    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+
+    // Pick the backend from the command line, epoll by default
+    std::string backend = argc > 1 ? argv[1] : "epoll";
+    if (backend == "epoll") {
+        run<EpollReactor>("epoll");
+    }
+#ifdef HAVE_IO_URING
+    else if (backend == "uring") {
+        run<IoUringReactor>("uring");
+    }
+#endif
+    else {
+        fprintf(stderr, "Usage: %s [epoll|uring]\n", argv[0]);
+        return 1;
+    }
 }
@@ -0,0 +1,96 @@
+#include "Reactor.h"
+#include "AsmUtils.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace hbthreads;
+
+/**
+ * A reactor that does not watch anything - we only want to measure
+ * the cost of managing subscriptions and dispatching to them
+ */
+struct FakeReactor : public Reactor {
+    FakeReactor(MemoryStorage* mem) : Reactor(mem) {
+    }
+    void onSocketOps(int /*fd*/, Operation /*ops*/) override {
+        // just ignore
+    }
+    void notify(int fd) {
+        notifyEvent(fd, EventType::SocketRead);
+    }
+};
+
+/**
+ * The worker will just wait for events in an empty loop
+ */
+struct Worker : public LightThread {
+    void run() override {
+        while (true) {
+            wait();
+        }
+    }
+};
+
+//! Number of coroutines the file descriptors are spread over
+static const int NUMTHREADS = 64;
+
+//! Runs one round of measurements with `numfds` fake file descriptors
+void bench(std::vector<Pointer<Worker>>& workers, int numfds) {
+    Pointer<FakeReactor> reactor(new FakeReactor(storage));
+
+    // Subscribe every descriptor to one of the workers
+    uint64_t t0 = tic();
+    for (int fd = 0; fd < numfds; ++fd) {
+        reactor->monitor(fd, workers[fd % NUMTHREADS].get());
+    }
+    uint64_t monitor_cycles = (tic() - t0) / numfds;
+
+    // Fire events on descriptors scattered all over the table
+    const int numevents = 1000000;
+    t0 = tic();
+    for (int j = 0; j < numevents; ++j) {
+        reactor->notify((int64_t(j) * 7919) % numfds);
+    }
+    uint64_t notify_cycles = (tic() - t0) / numevents;
+
+    // Remove all sockets one by one
+    t0 = tic();
+    for (int fd = 0; fd < numfds; ++fd) {
+        reactor->removeSocket(fd);
+    }
+    uint64_t socket_cycles = (tic() - t0) / numfds;
+
+    // Subscribe again and remove thread by thread
+    for (int fd = 0; fd < numfds; ++fd) {
+        reactor->monitor(fd, workers[fd % NUMTHREADS].get());
+    }
+    t0 = tic();
+    for (Pointer<Worker>& worker : workers) {
+        reactor->removeThread(worker.get());
+    }
+    uint64_t thread_cycles = (tic() - t0) / numfds;
+
+    printf("%8d %12lu %12lu %14lu %14lu\n", numfds, monitor_cycles, notify_cycles,
+           socket_cycles, thread_cycles);
+}
+
+int main() {
+    // Usual to avoid mallocs
+    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+
+    std::vector<Pointer<Worker>> workers(NUMTHREADS);
+    for (Pointer<Worker>& worker : workers) {
+        worker.reset(new Worker);
+        worker->start(4 * 1024);
+    }
+
+    // All numbers are cycles per operation (subscription or event)
+    printf("%8s %12s %12s %14s %14s\n", "fds", "monitor", "notify", "removeSocket",
+           "removeThread");
+    for (int numfds : {10, 100, 1000, 10000, 100000}) {
+        bench(workers, numfds);
+    }
+}
@@ -0,0 +1,52 @@
+#include "LightThread.h"
+#include "StackPool.h"
+#include "DateTime.h"
+#include "AsmUtils.h"
+
+#include <cstdio>
+
+using namespace hbthreads;
+
+/**
+ * A thread that finishes right away - we only measure spawn and teardown
+ */
+struct Task : public LightThread {
+    void run() override {
+    }
+};
+
+//! Creates, runs and destroys `numloops` threads and prints the cost of each
+void bench(const char* name, std::size_t stack_size, int numloops) {
+    DateTime start = DateTime::now(DateTime::ClockType::Monotonic);
+    uint64_t t0 = tic();
+    for (int j = 0; j < numloops; ++j) {
+        Pointer<Task> task(new Task);
+        task->start(stack_size);
+    }
+    uint64_t cycles = (tic() - t0) / numloops;
+    DateTime elapsed = DateTime::now(DateTime::ClockType::Monotonic) - start;
+    printf("%-10s %8zu %12lu %10.1f\n", name, stack_size, cycles,
+           double(elapsed.nsecs()) / numloops);
+}
+
+int main() {
+    // Usual to avoid mallocs
+    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+
+    const int numloops = 100000;
+    printf("%-10s %8s %12s %10s\n", "stacks", "size", "cycles", "ns");
+    for (std::size_t stack_size : {4 * 1024, 64 * 1024, 1024 * 1024}) {
+        // Every thread maps, protects and unmaps its own stack
+        stack_pool = nullptr;
+        bench("mmap", stack_size, numloops);
+
+        // Stacks are preallocated and recycled
+        StackPool stacks;
+        stacks.reserve(stack_size, 1);
+        stack_pool = &stacks;
+        bench("pool", stack_size, numloops);
+        stack_pool = nullptr;
+    }
+}
@@ -49,6 +49,63 @@ struct Worker : public LightThread {
     }
 };
 
+/**
+ * A reactor that fires all its fake descriptors on every call
+ */
+struct FanInReactor : public Reactor {
+    FanInReactor(MemoryStorage* mem, int nfds) : Reactor(mem), numfds(nfds) {
+    }
+    int numfds;
+    void onSocketOps(int /*fd*/, Operation /*ops*/) override {
+        // just ignore
+    }
+    void work() {
+        for (int fd = 0; fd < numfds; ++fd) {
+            deliverEvent(fd, EventType::SocketRead);
+        }
+        flushEvents();
+    }
+};
+
+/**
+ * The fan-in worker counts how many times it was resumed
+ */
+struct FanInWorker : public LightThread {
+    int64_t numevents;
+    int64_t events = 0;
+    int64_t switches = 0;
+    FanInWorker(int64_t nevents) : numevents(nevents) {
+    }
+    void run() override {
+        while (events < numevents) {
+            Event* ev = wait();
+            switches++;
+            events += ev->count;
+        }
+    }
+};
+
+//! One thread subscribed to `numfds` sockets that are always ready
+void fanin(int numfds, bool batching) {
+    const int64_t numevents = 1000000;
+    Pointer<FanInReactor> reactor(new FanInReactor(storage, numfds));
+    reactor->setBatching(batching);
+    Pointer<FanInWorker> worker(new FanInWorker(numevents));
+    worker->start(4 * 1024);
+    for (int fd = 0; fd < numfds; ++fd) {
+        reactor->monitor(fd, worker.get());
+    }
+
+    uint64_t t0 = tic();
+    while (reactor->active()) {
+        reactor->work();
+    }
+    uint64_t elapsed = tic() - t0;
+    printf("Fan-in %3d fds %-9s: %8ld switches %6.1f cycles/event\n", numfds,
+           batching ? "batched" : "unbatched", worker->switches,
+           double(elapsed) / worker->events);
+}
+
 int main() {
     // Usual to avoid mallocs
     boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
@@ -84,4 +141,10 @@ int main() {
     Stats stats = worker->hist.summary();
     printf("Reaction: Average:%.0f cycles/iteration Median:%.0f cycles/iteration\n",
            stats.average, stats.median);
+
+    // Batching saves one context switch per extra ready socket of a thread
+    for (int numfds : {1, 10, 50}) {
+        fanin(numfds, false);
+        fanin(numfds, true);
+    }
 }
@@ -29,6 +29,10 @@ class Server : public LightThread {
     int _port;
     char buffer[4096];
 
+    //! Subscription tags, handed back in the events
+    static constexpr std::uint64_t ListenerTag = 1;
+    static constexpr std::uint64_t ClientTag = 2;
+
 public:
     Server(Reactor* reactor, const char* address, int port) : _reactor(reactor) {
         _address = address;
@@ -46,8 +50,8 @@ public:
             return;
         }
 
-        // Start tracking this socket
-        _reactor->monitor(server_fd, this);
+        // Start tracking this socket, tagged so we can tell it from the clients
+        _reactor->monitor(server_fd, this, MonitorFlags::None, ListenerTag);
 
         // Mandatory listening
         printf("Server::run() listen\n");
@@ -65,7 +69,7 @@ public:
             Event* ev = wait();
 
             // First case, this is about handling connect requests
-            if (ev->fd == server_fd) {
+            if (ev->tag == ListenerTag) {
                 // NOTE: usleep removed - was causing 1 second delay in accept path
                 // For production HFT systems, accept should be immediate
                 struct sockaddr_in clientaddr;
@@ -81,7 +85,7 @@ public:
                 // We could do two things at this point:
                 // 1. Create a new object and monitor this socket into it
                 // 2. Just be lazy and funnel all data to this object (actual choice)
-                _reactor->monitor(client_fd, this);
+                _reactor->monitor(client_fd, this, MonitorFlags::None, ClientTag);
 
             } else {
                 // This is actual data through connections
@@ -3,12 +3,16 @@
 // https://www.geeksforgeeks.org/udp-server-client-implementation-c/
 
 #include "EpollReactor.h"
+#ifdef HAVE_IO_URING
+#include "IoUringReactor.h"
+#endif
 #include "MallocHooks.h"
 #include "Timer.h"
 #include "SocketUtils.h"
 
 #include <iostream>
 #include <array>
+#include <string>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -104,14 +108,9 @@ public:
     struct sockaddr_in servaddr;  //! server address to send messages to
 };
 
-// Driver code
-int main() {
-    // See timertest.cpp for more explanation on these settings
-    malloc_hook_active = 1;
-    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
-    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
-    storage = &buffer;
-
+//! Runs the client and server on the given reactor until both are done
+template <typename ReactorType>
+void run() {
     // Perhaps we should get this from the command line - or not
     const char *server_address = "127.0.0.1";
     int server_port = 8080;
@@ -133,7 +132,7 @@ int main() {
     bindSocket(server_fd, server_address, server_port);
 
     // Creates the event loop reactor
-    Pointer<EpollReactor> mgr(new EpollReactor(storage, DateTime::msecs(500)));
+    Pointer<ReactorType> mgr(new ReactorType(storage, DateTime::msecs(500)));
 
     // Subscribe the client to the timer
     mgr->monitor(timer.fd(), client.get());
@@ -148,5 +147,32 @@ int main() {
 
     // Close server socket
     ::close(server_fd);
+}
+
+// Driver code
+int main(int argc, char *argv[]) {
+    // Pick the backend from the command line, epoll by default
+    std::string backend = argc > 1 ? argv[1] : "epoll";
+
+    // See timertest.cpp for more explanation on these settings
+    malloc_hook_active = 1;
+    boost::container::pmr::monotonic_buffer_resource pool(8 * 1024ULL);
+    boost::container::pmr::unsynchronized_pool_resource buffer(&pool);
+    storage = &buffer;
+
+    if (backend == "epoll") {
+        run<EpollReactor>();
+    }
+#ifdef HAVE_IO_URING
+    else if (backend == "uring") {
+        run<IoUringReactor>();
+    }
+#endif
+    else {
+        malloc_hook_active = 0;
+        fprintf(stderr, "Usage: %s [epoll|uring]\n", argv[0]);
+        return 1;
+    }
+    malloc_hook_active = 0;
     return 0;
-}
\ No newline at end of file
+}